@@ -0,0 +1,324 @@
+/**
+ * @file bench.c
+ * @author Michele Riva (micheleriva@protonmail.com)
+ * @brief AOS WiFi client benchmarks
+ * @version 0.9.0
+ * @date 2023-04-17
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Runs the client against the simulated driver and prints one JSON line per benchmark.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <aos.h>
+#include <aos_wifi_client.h>
+#include <aos_wifi_client_sim.h>
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_idf_version.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <sdkconfig.h>
+#if !CONFIG_IDF_TARGET_LINUX
+#include <esp_heap_caps.h>
+#ifdef CONFIG_HEAP_TRACING_STANDALONE
+#include <esp_heap_trace.h>
+#endif
+#endif
+
+#define BENCH_ITERATIONS 50    // Samples per latency benchmark
+#define BENCH_STORM_EVENTS 200 // Events posted by the storm benchmark
+#define BENCH_FLAPS 20         // Link drops in the flap benchmark
+#define BENCH_TIMEOUT_MS 10000 // Give up waiting for the client after this
+
+static const char *_ssid = "BENCH_SSID";
+static const char *_password = "BENCH_PASSWORD";
+static const aos_wifi_client_sim_ap_t _aps[] = {
+    {.ssid = "BENCH_SSID", .password = "BENCH_PASSWORD", .bssid = {0x02, 0, 0, 0, 0, 1}, .channel = 1, .rssi = -50},
+    {.ssid = "BENCH_SSID", .password = "BENCH_PASSWORD", .bssid = {0x02, 0, 0, 0, 0, 2}, .channel = 6, .rssi = -60},
+    {.ssid = "OTHER_SSID", .bssid = {0x02, 0, 0, 0, 0, 3}, .channel = 11, .rssi = -70},
+};
+static aos_wifi_client_scan_result_t _results[16];
+static SemaphoreHandle_t _reconnected;
+
+#if !CONFIG_IDF_TARGET_LINUX && defined(CONFIG_HEAP_TRACING_STANDALONE)
+static heap_trace_record_t _trace_records[512];
+#endif
+
+typedef struct bench_series_t
+{
+    int64_t samples[BENCH_ITERATIONS];
+    size_t count;
+    size_t allocs;
+    bool allocs_valid;
+    size_t heap_free;  // Free heap when the running operation began
+    size_t heap_peak;  // Most heap used by a single operation, on top of what was used before it
+    bool heap_valid;
+} bench_series_t;
+
+static void bench_event_handler(aos_wifi_client_event_t event, void *args)
+{
+    if (event == AOS_WIFI_CLIENT_EVENT_RECONNECTED)
+        xSemaphoreGive(_reconnected);
+}
+
+static void bench_heap_begin(bench_series_t *series)
+{
+#if !CONFIG_IDF_TARGET_LINUX && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    // Until stopped, the minimum free size is the one seen during the operation only
+    series->heap_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_start();
+#endif
+#if !CONFIG_IDF_TARGET_LINUX && defined(CONFIG_HEAP_TRACING_STANDALONE)
+    heap_trace_start(HEAP_TRACE_ALL);
+#endif
+}
+
+static void bench_heap_end(bench_series_t *series)
+{
+#if !CONFIG_IDF_TARGET_LINUX && defined(CONFIG_HEAP_TRACING_STANDALONE)
+    series->allocs += heap_trace_get_count();
+    series->allocs_valid = true;
+    heap_trace_stop();
+#endif
+#if !CONFIG_IDF_TARGET_LINUX && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    size_t min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+    if (series->heap_free > min_free && series->heap_free - min_free > series->heap_peak)
+        series->heap_peak = series->heap_free - min_free;
+    series->heap_valid = true;
+#endif
+}
+
+static int bench_compare(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_print(const char *name, bench_series_t *series, const char *extra)
+{
+    if (!series->count)
+    {
+        printf("{\"bench\":\"%s\",\"n\":0}\n", name);
+        return;
+    }
+    qsort(series->samples, series->count, sizeof(int64_t), bench_compare);
+    int64_t sum = 0;
+    for (size_t i = 0; i < series->count; i++)
+        sum += series->samples[i];
+
+    char allocs[16] = "null";
+    if (series->allocs_valid)
+        snprintf(allocs, sizeof(allocs), "%u", (unsigned int)(series->allocs / series->count));
+    char heap[16] = "null";
+    if (series->heap_valid)
+        snprintf(heap, sizeof(heap), "%u", (unsigned int)series->heap_peak);
+
+    printf("{\"bench\":\"%s\",\"n\":%u,\"min_us\":%lld,\"avg_us\":%lld,\"p50_us\":%lld,\"p95_us\":%lld,\"max_us\":%lld,\"allocs\":%s,\"heap_peak\":%s%s}\n",
+           name, (unsigned int)series->count,
+           (long long)series->samples[0],
+           (long long)(sum / (int64_t)series->count),
+           (long long)series->samples[series->count / 2],
+           (long long)series->samples[series->count * 95 / 100],
+           (long long)series->samples[series->count - 1],
+           allocs, heap, extra ? extra : "");
+}
+
+static uint32_t bench_connect(aos_future_t *connect)
+{
+    AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(connect);
+    args->in_ssid = _ssid;
+    args->in_password = _password;
+    aos_await(aos_wifi_client_connect(connect));
+    return args->out_err;
+}
+
+static void bench_requests(void)
+{
+    bench_series_t connect_series = {}, disconnect_series = {}, scan_series = {};
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_ssid, _password, 0, 0, false);
+    aos_future_t *disconnect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_disconnect)();
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(_results, sizeof(_results) / sizeof(_results[0]), NULL, 0, 0, 0);
+    if (!connect || !disconnect || !scan)
+    {
+        printf("{\"bench\":\"error\",\"reason\":\"alloc\"}\n");
+        goto bench_requests_end;
+    }
+
+    for (size_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        bench_heap_begin(&connect_series);
+        int64_t begin = esp_timer_get_time();
+        uint32_t err = bench_connect(connect);
+        int64_t elapsed = esp_timer_get_time() - begin;
+        bench_heap_end(&connect_series);
+        if (!err)
+            connect_series.samples[connect_series.count++] = elapsed;
+
+        bench_heap_begin(&disconnect_series);
+        begin = esp_timer_get_time();
+        aos_await(aos_wifi_client_disconnect(disconnect));
+        elapsed = esp_timer_get_time() - begin;
+        bench_heap_end(&disconnect_series);
+        disconnect_series.samples[disconnect_series.count++] = elapsed;
+    }
+
+    for (size_t i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        bench_heap_begin(&scan_series);
+        int64_t begin = esp_timer_get_time();
+        aos_await(aos_wifi_client_scan(scan));
+        int64_t elapsed = esp_timer_get_time() - begin;
+        bench_heap_end(&scan_series);
+        AOS_ARGS_T(aos_wifi_client_scan) *args = aos_args_get(scan);
+        if (!args->out_err)
+            scan_series.samples[scan_series.count++] = elapsed;
+    }
+
+    bench_print("connect", &connect_series, NULL);
+    bench_print("disconnect", &disconnect_series, NULL);
+    bench_print("scan", &scan_series, NULL);
+
+bench_requests_end:
+    if (connect)
+        aos_awaitable_free(connect);
+    if (disconnect)
+        aos_awaitable_free(disconnect);
+    if (scan)
+        aos_awaitable_free(scan);
+}
+
+static void bench_storm(void)
+{
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_ssid, _password, 0, 0, false);
+    aos_future_t *event_stats = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_event_stats_get)((aos_wifi_client_event_stats_t){});
+    aos_future_t *stats = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_get_stats)((aos_wifi_client_stats_t){}, 0);
+    if (!connect || !event_stats || !stats || bench_connect(connect))
+    {
+        printf("{\"bench\":\"storm\",\"n\":0}\n");
+        goto bench_storm_end;
+    }
+
+    AOS_ARGS_T(aos_wifi_client_event_stats_get) *event_stats_args = aos_args_get(event_stats);
+    AOS_ARGS_T(aos_wifi_client_get_stats) *stats_args = aos_args_get(stats);
+    aos_await(aos_wifi_client_event_stats_get(event_stats));
+    uint32_t handled = event_stats_args->out_stats.wifi[WIFI_EVENT_STA_DISCONNECTED];
+    uint64_t handler_us = event_stats_args->out_stats.handler_us;
+    aos_await(aos_wifi_client_get_stats(stats));
+    uint32_t exhausted = stats_args->out_stats.pool_exhausted;
+
+    // Posting blocks while the event loop queue is full, so this measures how fast the client drains it
+    wifi_event_sta_disconnected_t event = {.reason = WIFI_REASON_BEACON_TIMEOUT};
+    int64_t begin = esp_timer_get_time();
+    for (size_t i = 0; i < BENCH_STORM_EVENTS; i++)
+        esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), portMAX_DELAY);
+    int64_t deadline = begin + BENCH_TIMEOUT_MS * 1000LL;
+    do
+        aos_await(aos_wifi_client_event_stats_get(event_stats));
+    while (event_stats_args->out_stats.wifi[WIFI_EVENT_STA_DISCONNECTED] - handled < BENCH_STORM_EVENTS &&
+           esp_timer_get_time() < deadline);
+    int64_t drained = esp_timer_get_time() - begin;
+
+    // The client is expected to end up connected, a connect request resolves once it is
+    uint32_t err = bench_connect(connect);
+    int64_t settled = esp_timer_get_time() - begin;
+    aos_await(aos_wifi_client_get_stats(stats));
+
+    uint32_t count = event_stats_args->out_stats.wifi[WIFI_EVENT_STA_DISCONNECTED] - handled;
+    printf("{\"bench\":\"storm\",\"n\":%u,\"drain_us\":%lld,\"events_per_s\":%lld,\"handler_avg_us\":%llu,\"settle_us\":%lld,\"settle_err\":%u,\"pool_exhausted\":%u,\"queue_hwm\":%u}\n",
+           (unsigned int)count, (long long)drained,
+           drained ? (long long)(count * 1000000LL / drained) : 0LL,
+           count ? (unsigned long long)(event_stats_args->out_stats.handler_us - handler_us) / count : 0,
+           (long long)settled, (unsigned int)err,
+           (unsigned int)(stats_args->out_stats.pool_exhausted - exhausted),
+           (unsigned int)stats_args->out_stats.queue_hwm);
+
+bench_storm_end:
+    if (connect)
+        aos_awaitable_free(connect);
+    if (event_stats)
+        aos_awaitable_free(event_stats);
+    if (stats)
+        aos_awaitable_free(stats);
+}
+
+static void bench_flap(void)
+{
+    bench_series_t series = {};
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_ssid, _password, 0, 0, false);
+    if (!connect || bench_connect(connect))
+    {
+        printf("{\"bench\":\"flap\",\"n\":0}\n");
+        goto bench_flap_end;
+    }
+
+    int64_t total = esp_timer_get_time();
+    for (size_t i = 0; i < BENCH_FLAPS && i < BENCH_ITERATIONS; i++)
+    {
+        xSemaphoreTake(_reconnected, 0);
+        bench_heap_begin(&series);
+        int64_t begin = esp_timer_get_time();
+        if (aos_wifi_client_sim_link_drop(WIFI_REASON_BEACON_TIMEOUT) != ESP_OK)
+            break;
+        bool recovered = xSemaphoreTake(_reconnected, pdMS_TO_TICKS(BENCH_TIMEOUT_MS)) == pdTRUE;
+        int64_t elapsed = esp_timer_get_time() - begin;
+        bench_heap_end(&series);
+        if (!recovered)
+            break;
+        series.samples[series.count++] = elapsed;
+    }
+    total = esp_timer_get_time() - total;
+
+    char extra[32];
+    snprintf(extra, sizeof(extra), ",\"total_us\":%lld", (long long)total);
+    bench_print("flap", &series, extra);
+
+bench_flap_end:
+    if (connect)
+        aos_awaitable_free(connect);
+}
+
+void app_main(void)
+{
+    esp_netif_init();
+    _reconnected = xSemaphoreCreateBinary();
+#if !CONFIG_IDF_TARGET_LINUX && defined(CONFIG_HEAP_TRACING_STANDALONE)
+    heap_trace_init_standalone(_trace_records, sizeof(_trace_records) / sizeof(_trace_records[0]));
+#endif
+
+    // Short but non zero delays, so that requests actually wait on the driver
+    aos_wifi_client_sim_config_t sim_config = {
+        .aps = _aps,
+        .aps_count = sizeof(_aps) / sizeof(_aps[0]),
+        .scan_duration_ms = 130,
+        .connect_duration_ms = 20,
+        .dhcp_delay_ms = 10};
+    aos_wifi_client_sim_setup(&sim_config);
+
+    aos_wifi_client_config_t config = {
+        .connection_attempts = 3,
+        .reconnection_attempts = UINT32_MAX,
+        .event_handler = bench_event_handler,
+        .driver = &aos_wifi_client_driver_sim};
+    aos_wifi_client_init(&config);
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    aos_await(aos_wifi_client_start(start));
+    aos_awaitable_free(start);
+
+    printf("{\"bench\":\"info\",\"idf\":\"%s\",\"target\":\"%s\",\"iterations\":%u}\n",
+           esp_get_idf_version(), CONFIG_IDF_TARGET, BENCH_ITERATIONS);
+    bench_requests();
+    bench_storm();
+    bench_flap();
+    printf("{\"bench\":\"done\"}\n");
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    aos_await(aos_wifi_client_stop(stop));
+    aos_awaitable_free(stop);
+}
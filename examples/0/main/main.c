@@ -30,11 +30,20 @@ void app_main(void)
     esp_netif_init();
 
     // Initialize AOS WiFi client
-    // All fields are mandatory, we want to be explicit
+    // Attempts are mandatory, the event handler is optional and only prints events here
     aos_wifi_client_config_t config = {
         .connection_attempts = UINT32_MAX,
         .reconnection_attempts = UINT32_MAX,
-        .event_handler = wifi_event_handler};
+        .event_handler = wifi_event_handler,
+        .backoff = {
+            .initial_delay_ms = 500,
+            .max_delay_ms = 30000,
+            .multiplier = 2,
+            .jitter_pct = 20},
+        .roaming = {
+            .rssi_threshold = -70,
+            .hysteresis_db = 8,
+            .min_dwell_ms = 10000}};
     aos_wifi_client_init(&config);
 
     // Start the client for example with an awaitable future
@@ -43,7 +52,7 @@ void app_main(void)
     aos_awaitable_free(start);
 
     // Scan for networks
-    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(_results, 10, 0, 0);
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(_results, 10, NULL, 0, 0, 0);
     aos_await(aos_wifi_client_scan(scan));
     AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
     for (size_t i = 0; i < scan_args->out_results_count; i++)
@@ -53,7 +62,7 @@ void app_main(void)
     aos_awaitable_free(scan);
 
     // Connect to a network
-    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0);
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
     aos_await(aos_wifi_client_connect(connect));
     aos_awaitable_free(connect);
 
@@ -20,12 +20,28 @@
  *  limitations under the License.
  */
 #include <aos.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    /**
+     * @brief Error codes reported through out_err
+     */
+    typedef enum aos_wifi_client_err_t
+    {
+        AOS_WIFI_CLIENT_ERR_NONE = 0,   // Success
+        AOS_WIFI_CLIENT_ERR_FAIL = 1,   // Generic failure
+        AOS_WIFI_CLIENT_ERR_DRIVER = 2, // WiFi driver returned an error
+        AOS_WIFI_CLIENT_ERR_AUTH = 3,   // Credentials or security settings rejected by the AP, retrying would not help
+        AOS_WIFI_CLIENT_ERR_BUSY = 4,   // Too many concurrent requests of the same kind
+        AOS_WIFI_CLIENT_ERR_TIMEOUT = 5, // Request timed out
+        AOS_WIFI_CLIENT_ERR_CANCELLED = 6, // Request cancelled through aos_wifi_client_cancel
+    } aos_wifi_client_err_t;
+
     /**
      * @brief WiFi client events
      */
@@ -34,18 +50,233 @@ extern "C"
         AOS_WIFI_CLIENT_EVENT_RECONNECTING, // WiFi client is reconnecting
         AOS_WIFI_CLIENT_EVENT_RECONNECTED,  // WiFi client reconnected successfully
         AOS_WIFI_CLIENT_EVENT_DISCONNECTED, // WiFi client disconnected unexpectedly
+        AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED, // Link quality fell below the link monitor thresholds
     } aos_wifi_client_event_t;
 
+    /**
+     * @brief WiFi client states
+     */
+    typedef enum aos_wifi_client_state_t
+    {
+        AOS_WIFI_CLIENT_STATE_DISCONNECTED, // Not connected, and not trying to
+        AOS_WIFI_CLIENT_STATE_CONNECTING,   // Connecting on request
+        AOS_WIFI_CLIENT_STATE_CONNECTED,    // Connected and got an IP address
+        AOS_WIFI_CLIENT_STATE_RECONNECTING, // Recovering a lost connection
+    } aos_wifi_client_state_t;
+
+    /**
+     * @brief Connection status snapshot, see aos_wifi_client_status_get
+     *
+     * Addresses are in network byte order, as in esp_ip4_addr_t. Link and address fields are zero unless connected.
+     */
+    typedef struct aos_wifi_client_status_t
+    {
+        aos_wifi_client_state_t state; // Client state
+        uint32_t ip;                   // IP address
+        uint32_t netmask;              // Netmask
+        uint32_t gw;                   // Gateway
+        uint8_t bssid[6];              // BSSID of the AP
+        uint8_t channel;               // Channel of the AP
+        int8_t rssi;                   // Signal strength, refreshed on connection, on roaming checks and by the link monitor
+        float rssi_avg;                // Moving average of the signal strength (dBm), link monitor only
+        float rssi_trend;              // Trend of rssi_avg (dB/s), link monitor only
+        uint32_t generation;           // Incremented on every change, 0 before the client is first started
+    } aos_wifi_client_status_t;
+
+    /**
+     * @brief Payload of AOS_WIFI_CLIENT_EVENT_RECONNECTED events
+     */
+    typedef struct aos_wifi_client_reconnected_t
+    {
+        bool fastpath; // Whether the cached BSSID/channel of the last association was used (no full scan)
+    } aos_wifi_client_reconnected_t;
+
+    /**
+     * @brief Payload of AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED events
+     */
+    typedef struct aos_wifi_client_link_degraded_t
+    {
+        int8_t rssi;      // Last sample (dBm)
+        float rssi_avg;   // Moving average (dBm)
+        float rssi_trend; // Trend of the moving average (dB/s)
+    } aos_wifi_client_link_degraded_t;
+
+#define AOS_WIFI_CLIENT_EVENT_MASK(event) (1UL << (event)) // Subscription mask bit of an aos_wifi_client_event_t
+#define AOS_WIFI_CLIENT_EVENT_MASK_ALL 0xFFFFFFFFUL          // Subscription mask of all events
+
+    /**
+     * @brief Item delivered to subscriber queues, see aos_wifi_client_subscribe
+     */
+    typedef struct aos_wifi_client_notification_t
+    {
+        aos_wifi_client_event_t event; // Event
+        uint32_t dropped;              // Notifications dropped for this subscriber since the previous one, because its queue was full
+        union
+        {
+            aos_wifi_client_reconnected_t reconnected;     // AOS_WIFI_CLIENT_EVENT_RECONNECTED payload
+            aos_wifi_client_link_degraded_t link_degraded; // AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED payload
+        } data;
+    } aos_wifi_client_notification_t;
+
+    /**
+     * @brief Retry scheduling policy
+     *
+     * The delay before retry n (starting from 1) is initial_delay_ms * multiplier^(n-1), bounded by max_delay_ms, and
+     * randomly spread by +/- jitter_pct percent so that devices losing the same AP do not retry in lockstep.
+     */
+    typedef struct aos_wifi_client_backoff_t
+    {
+        unsigned int initial_delay_ms; // Delay before the first retry, 0 to retry immediately (no backoff)
+        unsigned int max_delay_ms;     // Upper bound of the delay, 0 for no bound
+        float multiplier;              // Delay growth factor between consecutive retries, values below 1 are treated as 1
+        unsigned int jitter_pct;       // Random spread of each delay in percent (0-100)
+    } aos_wifi_client_backoff_t;
+
+    /**
+     * @brief Power save modes
+     *
+     * Latency figures refer to downlink traffic and depend on the AP beacon interval (usually 102.4ms) and DTIM period.
+     */
+    typedef enum aos_wifi_client_power_mode_t
+    {
+        AOS_WIFI_CLIENT_POWER_PERFORMANCE, // Radio always on (WIFI_PS_NONE). No added latency, full throughput, highest consumption.
+        AOS_WIFI_CLIENT_POWER_BALANCED,    // Radio wakes every DTIM (WIFI_PS_MIN_MODEM). Adds up to one DTIM period of latency.
+        AOS_WIFI_CLIENT_POWER_SAVING,      // Radio wakes every listen interval (WIFI_PS_MAX_MODEM). Adds up to listen_interval beacons of latency.
+    } aos_wifi_client_power_mode_t;
+
+    /**
+     * @brief Power profile
+     */
+    typedef struct aos_wifi_client_power_t
+    {
+        aos_wifi_client_power_mode_t mode; // Power save mode
+        uint16_t listen_interval;          // Beacon intervals between wake-ups in AOS_WIFI_CLIENT_POWER_SAVING mode, 0 for driver default (3)
+    } aos_wifi_client_power_t;
+
+    /**
+     * @brief Indicative costs of a power profile
+     */
+    typedef struct aos_wifi_client_power_tradeoff_t
+    {
+        unsigned int max_latency_ms; // Worst-case latency added to downlink traffic
+        unsigned int throughput_pct; // Expected throughput relative to AOS_WIFI_CLIENT_POWER_PERFORMANCE
+    } aos_wifi_client_power_tradeoff_t;
+
+    /**
+     * @brief Roaming policy
+     *
+     * When the signal of the current AP drops below rssi_threshold, the client scans for the same SSID in the
+     * background and reassociates to another AP of the same network if it is at least hysteresis_db stronger, before
+     * the link breaks. The IP configuration is kept, thus the application sees no disconnection.
+     */
+    typedef struct aos_wifi_client_roaming_t
+    {
+        int8_t rssi_threshold;     // RSSI (dBm) below which a better AP is looked for, 0 disables roaming
+        uint8_t hysteresis_db;     // Minimum RSSI advantage (dB) of the new AP over the current one
+        unsigned int min_dwell_ms; // Minimum time on an AP before roaming, also the interval between scans while the signal stays low
+    } aos_wifi_client_roaming_t;
+
+    /**
+     * @brief Link quality monitor
+     *
+     * While connected, the client samples the RSSI of the AP every period_ms and keeps an exponentially weighted moving
+     * average of it, along with its trend. Both are published in the status snapshot. When the average drops below
+     * rssi_threshold or the trend below trend_threshold, AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED is raised once, and again
+     * only after quality recovered in between. With reassociate set, a better AP of the same network is also looked for
+     * as roaming would, using its hysteresis_db and min_dwell_ms.
+     */
+    typedef struct aos_wifi_client_link_monitor_t
+    {
+        unsigned int period_ms; // Sampling period, 0 disables the monitor
+        float alpha;            // Weight of a new sample in the average, in (0, 1] (optional, 0 for 0.25)
+        int8_t rssi_threshold;  // Average RSSI (dBm) below which the link is degraded (optional, 0 for none)
+        float trend_threshold;  // Trend (dB/s, negative) below which the link is degraded (optional, 0 for none)
+        bool reassociate;       // Look for a better AP when the link is degraded
+    } aos_wifi_client_link_monitor_t;
+
+    /**
+     * @brief Roaming counters since the client was initialized
+     */
+    typedef struct aos_wifi_client_roam_stats_t
+    {
+        unsigned int scans;           // Background scans looking for a better AP
+        unsigned int attempts;        // Reassociations started
+        unsigned int successes;       // Reassociations completed with an IP on the new AP
+        unsigned int failures;        // Reassociations failed, recovered through regular reconnection
+        unsigned int last_latency_ms; // Time from leaving the old AP to getting an IP on the new one, last roam
+        unsigned int max_latency_ms;  // Same as last_latency_ms, worst roam
+    } aos_wifi_client_roam_stats_t;
+
+#define AOS_WIFI_CLIENT_EVENT_STATS_IDS 48 // Number of WIFI_EVENT ids counted separately
+
+    /**
+     * @brief Driver event handler counters since the client was started the first time
+     */
+    typedef struct aos_wifi_client_event_stats_t
+    {
+        uint32_t wifi[AOS_WIFI_CLIENT_EVENT_STATS_IDS]; // Handler calls per WIFI_EVENT id
+        uint32_t wifi_other;                            // Handler calls for WIFI_EVENT ids beyond wifi
+        uint32_t ip;                                    // Handler calls for IP_EVENT ids
+        uint64_t handler_us;                            // Total time spent in the handler on the event loop task
+        uint32_t coalesced;                             // Events replaced by a newer one of the same type before being handled
+        uint32_t wakeups_failed;                        // Client task wake-ups that could not be sent right away, retried later
+    } aos_wifi_client_event_stats_t;
+
+#define AOS_WIFI_CLIENT_STATS_BUCKETS 12 // Number of latency histogram buckets
+#define AOS_WIFI_CLIENT_STATS_REASONS 96 // Number of disconnection reason counters
+#define AOS_WIFI_CLIENT_STATS_STATES 4   // Number of client states, see aos_wifi_client_state_t
+// Index of a WiFi driver disconnection reason (wifi_err_reason_t) in aos_wifi_client_stats_t.disconnect_reasons
+#define AOS_WIFI_CLIENT_STATS_REASON_INDEX(reason) ((reason) < 200 ? ((reason) < 63 ? (reason) : 63) : ((reason) - 200 < 31 ? 64 + (reason) - 200 : 95))
+
+    /**
+     * @brief Latency histogram
+     *
+     * Bucket 0 counts latencies below 32ms, bucket n counts latencies in [32 * 2^(n-1), 32 * 2^n) ms, and the last
+     * bucket counts everything above.
+     */
+    typedef struct aos_wifi_client_histogram_t
+    {
+        uint32_t buckets[AOS_WIFI_CLIENT_STATS_BUCKETS]; // Sample count per bucket
+        uint32_t count;                                  // Number of samples
+        uint32_t max_ms;                                 // Highest sample
+        uint64_t sum_ms;                                 // Sum of all samples, for the mean
+    } aos_wifi_client_histogram_t;
+
+    /**
+     * @brief Runtime statistics since the client was initialized
+     */
+    typedef struct aos_wifi_client_stats_t
+    {
+        aos_wifi_client_histogram_t connect_latency;               // From connection request to IP obtained
+        aos_wifi_client_histogram_t scan_latency;                  // From radio scan start to results available
+        uint64_t state_ms[AOS_WIFI_CLIENT_STATS_STATES];           // Time spent in each aos_wifi_client_state_t
+        uint32_t connection_attempts;                              // Association attempts while connecting on request
+        uint32_t reconnection_attempts;                            // Association attempts while recovering a lost connection
+        uint32_t disconnect_reasons[AOS_WIFI_CLIENT_STATS_REASONS]; // Disconnections per reason, see AOS_WIFI_CLIENT_STATS_REASON_INDEX
+        uint32_t pool_hwm;                                         // Most event pool futures in use at once
+        uint32_t pool_exhausted;                                   // Notifications deferred because the event pool was empty
+        uint32_t queue_hwm;                                        // Most messages queued to the client task at once
+        uint32_t boot_to_ip_ms;                                    // Time from boot (or deep sleep wake-up) to the first IP address, 0 before
+        bool boot_lease_reused;                                    // The first IP address came from a lease persisted across deep sleep
+    } aos_wifi_client_stats_t;
+
     /**
      * @brief WiFi client configuration
      *
-     * @warning The event_handler element is mandatory!
+     * @note The event_handler is called by the client task and delays connection handling for as long as it runs. Prefer
+     * aos_wifi_client_subscribe for anything but trivial handlers.
      */
     typedef struct aos_wifi_client_config_t
     {
         unsigned int connection_attempts;                                 // Number of connection attempts before giving up
         unsigned int reconnection_attempts;                               // Number or recovery attempts before giving up
-        void (*event_handler)(aos_wifi_client_event_t event, void *args); // Event handler, will receive notifications of unexpected WiFi events
+        void (*event_handler)(aos_wifi_client_event_t event, void *args); // Event handler, will receive notifications of unexpected WiFi events (optional)
+        aos_wifi_client_backoff_t backoff;                                // Delay policy between connection and reconnection attempts (optional)
+        aos_wifi_client_power_t power;                                    // Power profile applied on start (optional, defaults to AOS_WIFI_CLIENT_POWER_PERFORMANCE)
+        unsigned int scan_cache_max_age_ms;                               // Scan requests are answered from the last scan results if younger than this (optional, 0 disables caching)
+        aos_wifi_client_roaming_t roaming;                                // Roaming between APs of the same network (optional, disabled by default)
+        aos_wifi_client_link_monitor_t link_monitor;                      // Link quality monitor (optional, disabled by default)
+        const struct aos_wifi_client_driver_t *driver;                    // WiFi driver (optional, defaults to the ESP WiFi driver, or to the simulated one on the linux target)
     } aos_wifi_client_config_t;
 
     /**
@@ -76,16 +307,30 @@ extern "C"
      */
     aos_future_t *aos_wifi_client_stop(aos_future_t *future);
 
-    AOS_DECLARE(aos_wifi_client_connect, const char *in_ssid, const char *in_password, unsigned int out_err)
+    AOS_DECLARE(aos_wifi_client_connect, const char *in_ssid, const char *in_password, unsigned int in_timeout_ms, unsigned int out_err, bool out_fastpath)
     /**
      * @brief Connect to a given WiFi network.
      *
-     * @note In case of multiple consecutive calls, futures not yet resolved will be resolved with out_err = 1.
+     * @note In case of multiple consecutive calls, futures not yet resolved will be resolved with out_err = 1, unless
+     * they target the same network: identical requests are served by a single association attempt and resolved together
+     * (up to CONFIG_AOS_WIFI_CLIENT_CONNECT_JOINED, further ones get out_err = AOS_WIFI_CLIENT_ERR_BUSY).
+     * @note Connection and disconnection requests queued back to back only reach the driver for their net effect, e.g.
+     * disconnecting and connecting again to the current network keeps the link up.
+     * @note Disconnection reasons which retrying cannot fix (e.g. wrong password) resolve the future right away with
+     * out_err = AOS_WIFI_CLIENT_ERR_AUTH instead of consuming the remaining connection attempts.
+     * @note The BSSID, channel and auth mode of the last successful association are cached and used as hints when
+     * connecting again to the same SSID, skipping the full channel scan. If the hinted attempt fails, the client falls
+     * back to a full scan.
+     * @note With in_timeout_ms set, the future is resolved with out_err = AOS_WIFI_CLIENT_ERR_TIMEOUT once it expires,
+     * whatever connection_attempts allows. Unless an identical request still waits for it, the association attempt is
+     * then abandoned and the client is left disconnected.
      *
      * @param future Future
      * @param in_ssid (on future) SSID
      * @param in_password (on future) Password (if any)
-     * @param out_err (on future) 0 if success, 1 otherwise
+     * @param in_timeout_ms (on future) Maximum time to connect, 0 to rely on connection_attempts only
+     * @param out_err (on future) 0 if success, an aos_wifi_client_err_t otherwise
+     * @param out_fastpath (on future) Whether the connection was established through the cached hint (fast path) or a full scan (slow path)
      * @return aos_future_t* Same future as input
      */
     aos_future_t *aos_wifi_client_connect(aos_future_t *future);
@@ -94,33 +339,303 @@ extern "C"
     /**
      * @brief Disconnect from current WiFi network (if any)
      *
+     * @note When more requests are queued, the disconnection is applied after them together with any connection
+     * request among them, the future is resolved right away.
+     *
      * @param future Future
      * @return aos_future_t* Same future as input
      */
     aos_future_t *aos_wifi_client_disconnect(aos_future_t *future);
 
+    AOS_DECLARE(aos_wifi_client_wait_connected, unsigned int in_timeout_ms, uint32_t out_err)
+    /**
+     * @brief Wait until the client is connected and got an IP address
+     *
+     * Resolved at once if already connected. Does not trigger a connection, any number of tasks can wait (up to
+     * CONFIG_AOS_WIFI_CLIENT_CONNECTED_WAITERS at a time) and all of them are resolved together as soon as the IP
+     * address is obtained.
+     *
+     * @param future Future
+     * @param in_timeout_ms (on future) Maximum wait, 0 to wait forever
+     * @param out_err (on future) 0 if connected, AOS_WIFI_CLIENT_ERR_TIMEOUT if timed out, AOS_WIFI_CLIENT_ERR_BUSY if
+     * too many tasks are waiting, AOS_WIFI_CLIENT_ERR_FAIL if the client was stopped
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_wait_connected(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_subscribe, QueueHandle_t in_queue, uint32_t in_mask, uint32_t out_err)
+    /**
+     * @brief Subscribe a queue to client events, or change the events it is subscribed to
+     *
+     * Notifications are aos_wifi_client_notification_t items, the queue must be created with that item size. They are
+     * sent without waiting, so a slow subscriber never delays the client, if its queue is full the notification is
+     * dropped and accounted in the next one. Up to CONFIG_AOS_WIFI_CLIENT_SUBSCRIBERS queues can be subscribed.
+     *
+     * @param future Future
+     * @param in_queue (on future) Queue
+     * @param in_mask (on future) Events to deliver, a combination of AOS_WIFI_CLIENT_EVENT_MASK, 0 unsubscribes
+     * @param out_err (on future) 0 if success, AOS_WIFI_CLIENT_ERR_BUSY if there are too many subscribers
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_subscribe(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_network_add, const char *in_ssid, const char *in_password, uint8_t in_priority, uint32_t out_err)
+    /**
+     * @brief Add a network to the known networks, or update it if already known
+     *
+     * The store is kept in memory and holds up to CONFIG_AOS_WIFI_CLIENT_NETWORKS networks.
+     *
+     * @param future Future
+     * @param in_ssid (on future) SSID, copied on request
+     * @param in_password (on future) Password (if any), copied on request
+     * @param in_priority (on future) Priority, higher values are preferred over signal strength
+     * @param out_err (on future) 0 if success, AOS_WIFI_CLIENT_ERR_BUSY if the store is full, an aos_wifi_client_err_t otherwise
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_network_add(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_network_remove, const char *in_ssid, uint32_t out_err)
+    /**
+     * @brief Remove a network from the known networks
+     *
+     * @param future Future
+     * @param in_ssid (on future) SSID
+     * @param out_err (on future) 0 if success, 1 if the network is not known
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_network_remove(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_connect_best, unsigned int in_timeout_ms, uint32_t out_err, bool out_fastpath)
+    /**
+     * @brief Connect to the best visible known network
+     *
+     * Runs a single scan (or uses the scan cache), ranks the visible known networks by priority and then by signal
+     * strength, and connects to the first one. If it cannot be connected, the next candidate is tried, until none is
+     * left. Each candidate gets connection_attempts attempts.
+     *
+     * @note Resolved with out_err = 1 if superseded by aos_wifi_client_connect, aos_wifi_client_disconnect or another
+     * aos_wifi_client_connect_best.
+     * @note With in_timeout_ms set, the future is resolved with out_err = AOS_WIFI_CLIENT_ERR_TIMEOUT once it expires,
+     * whether still scanning or connecting.
+     *
+     * @param future Future
+     * @param in_timeout_ms (on future) Maximum time to scan and connect over all candidates, 0 to rely on attempts only
+     * @param out_err (on future) 0 if success, an aos_wifi_client_err_t otherwise (that of the last candidate)
+     * @param out_fastpath (on future) Whether the connection was established through the cached hint (fast path) or a full scan (slow path)
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_connect_best(aos_future_t *future);
+
+    /**
+     * @brief Entry of an aos_wifi_client_connect_list request
+     */
+    typedef struct aos_wifi_client_credentials_t
+    {
+        const char *ssid;      // SSID
+        const char *password;  // Password, NULL or empty for open networks
+        unsigned int attempts; // Connection attempts before falling back to the next entry (optional, 0 for connection_attempts)
+    } aos_wifi_client_credentials_t;
+    AOS_DECLARE(aos_wifi_client_connect_list, const aos_wifi_client_credentials_t *in_list, size_t in_count, unsigned int in_timeout_ms, uint32_t out_err, size_t out_index, bool out_fastpath)
+    /**
+     * @brief Connect to the first network of an ordered list that can be connected
+     *
+     * Entries are tried in order by the client task, each with its own attempts budget. Credentials which retrying
+     * cannot fix (e.g. wrong password) move on to the next entry right away. Superseding, deadline and cancellation
+     * behave as in aos_wifi_client_connect, except that list requests are never joined.
+     *
+     * @param future Future
+     * @param in_list (on future) Networks in order of preference, copied on request
+     * @param in_count (on future) Number of entries, up to CONFIG_AOS_WIFI_CLIENT_FALLBACKS
+     * @param in_timeout_ms (on future) Maximum time to connect over the whole list, 0 to rely on attempts only
+     * @param out_err (on future) 0 if success, an aos_wifi_client_err_t otherwise (that of the last entry)
+     * @param out_index (on future) Entry connected to, or the last one tried (the invalid one if out_err is AOS_WIFI_CLIENT_ERR_FAIL on input checking)
+     * @param out_fastpath (on future) Whether the connection was established through the cached hint (fast path) or a full scan (slow path)
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_connect_list(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_set_power_mode, aos_wifi_client_power_mode_t in_mode, uint16_t in_listen_interval, unsigned int out_err)
+    /**
+     * @brief Switch power save mode at runtime, without reconnecting
+     *
+     * @note The listen interval is negotiated with the AP on association, thus a new value only takes effect on the next connection.
+     *
+     * @param future Future
+     * @param in_mode (on future) Power save mode
+     * @param in_listen_interval (on future) Beacon intervals between wake-ups in AOS_WIFI_CLIENT_POWER_SAVING mode, 0 for driver default
+     * @param out_err (on future) 0 if success, an aos_wifi_client_err_t otherwise
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_set_power_mode(aos_future_t *future);
+
+    /**
+     * @brief Estimate latency and throughput costs of a power profile
+     *
+     * Estimates assume a 102.4ms beacon interval and a DTIM period of 1, which are the most common AP defaults.
+     *
+     * @param power Power profile
+     * @param tradeoff Estimated costs
+     */
+    void aos_wifi_client_power_tradeoff_get(const aos_wifi_client_power_t *power, aos_wifi_client_power_tradeoff_t *tradeoff);
+
     /**
      * @brief Scan result entry
      */
     typedef struct aos_wifi_client_scan_result_t
     {
-        char ssid[34];  // SSID
-        float strength; // Signal strength on a 0-1 scale, higher is better
-        bool open;      // Whether network is open or requires password
+        char ssid[34];    // SSID
+        float strength;   // Signal strength on a 0-1 scale, higher is better
+        bool open;        // Whether network is open or requires password
+        uint8_t bssid[6]; // AP MAC address
+        int8_t rssi;      // Raw signal strength (dBm)
+        uint8_t channel;  // Primary channel
     } aos_wifi_client_scan_result_t;
-    AOS_DECLARE(aos_wifi_client_scan, aos_wifi_client_scan_result_t *in_results, size_t in_results_size, size_t out_results_count, uint32_t out_err)
+
+    /**
+     * @brief Scan parameters
+     *
+     * A zero-initialized spec (or NULL) performs the default active scan of every channel. Narrowing the scan to a
+     * single channel and SSID reduces it from seconds to tens of milliseconds.
+     */
+    typedef struct aos_wifi_client_scan_spec_t
+    {
+        const char *ssid;        // Only report this SSID (optional, NULL for any)
+        const uint8_t *bssid;    // Only report this BSSID, 6 bytes (optional, NULL for any)
+        uint8_t channel;         // Only scan this channel (optional, 0 to use channel_bitmap)
+        uint16_t channel_bitmap; // Only scan these 2.4 GHz channels, bit n is channel n (optional, 0 for all)
+        bool passive;            // Listen for beacons instead of sending probe requests
+        uint16_t min_dwell_ms;   // Minimum active scan time per channel (optional, 0 for driver default)
+        uint16_t max_dwell_ms;   // Maximum scan time per channel (optional, 0 for driver default)
+        bool show_hidden;        // Report networks not broadcasting their SSID
+    } aos_wifi_client_scan_spec_t;
+    AOS_DECLARE(aos_wifi_client_scan, aos_wifi_client_scan_result_t *in_results, size_t in_results_size, const aos_wifi_client_scan_spec_t *in_spec, unsigned int in_timeout_ms, size_t out_results_count, uint32_t out_err)
     /**
      * @brief Scan for available networks
      *
+     * @note Requests arriving while a scan is running are served by the same scan instead of restarting it, up to
+     * CONFIG_AOS_WIFI_CLIENT_SCAN_WAITERS concurrent requests. If scan_cache_max_age_ms is configured, requests are
+     * answered from the last results (up to CONFIG_AOS_WIFI_CLIENT_SCAN_CACHE_SIZE networks) while they are fresh.
+     * Only requests with identical specs share a scan, others are queued and scanned afterwards. The cache only holds
+     * results of default scans.
+     * @note With in_timeout_ms set, the future is resolved with out_err = AOS_WIFI_CLIENT_ERR_TIMEOUT once it expires,
+     * along with the results collected so far (none, as results are only available at the end of a scan). The running
+     * scan is stopped if no other request is served by it.
+     *
      * @param future Future
      * @param in_results (on future) Pre-allocated on-heap structure to allocate results
      * @param in_results_size (on future) Number of slots in in_results structure
+     * @param in_spec (on future) Scan parameters, copied on request (optional, NULL for a default scan)
+     * @param in_timeout_ms (on future) Maximum time to scan, 0 to wait for the scan to finish
      * @param out_results_count (on future) Number of results
-     * @param out_err (on future) 0 if success, 1 otherwise. Note that the ESP WiFi driver cannot scan while connecting to a network.
+     * @param out_err (on future) 0 if success, an aos_wifi_client_err_t otherwise. Note that the ESP WiFi driver cannot scan while connecting to a network.
      * @return aos_future_t* Same future as input
      */
     aos_future_t *aos_wifi_client_scan(aos_future_t *future);
 
+    /**
+     * @brief Scan result callback
+     *
+     * @param result Scan result, only valid for the duration of the call
+     * @param arg User argument given with the request
+     * @return true to receive further results, false to stop
+     */
+    typedef bool (*aos_wifi_client_scan_cb_t)(const aos_wifi_client_scan_result_t *result, void *arg);
+    AOS_DECLARE(aos_wifi_client_scan_stream, aos_wifi_client_scan_cb_t in_callback, void *in_arg, const aos_wifi_client_scan_spec_t *in_spec, unsigned int in_timeout_ms, size_t out_results_count, uint32_t out_err)
+    /**
+     * @brief Scan for available networks, streaming results one at a time
+     *
+     * Results are fetched from the driver one record at a time, thus no memory proportional to the number of visible
+     * networks is needed. The callback runs on the WiFi client task and should return quickly. Coalescing and caching
+     * behave as in aos_wifi_client_scan.
+     *
+     * @param future Future
+     * @param in_callback (on future) Callback receiving each result
+     * @param in_arg (on future) User argument passed to the callback
+     * @param in_spec (on future) Scan parameters, copied on request (optional, NULL for a default scan)
+     * @param in_timeout_ms (on future) Maximum time to scan, 0 to wait for the scan to finish
+     * @param out_results_count (on future) Number of results passed to the callback
+     * @param out_err (on future) 0 if success, an aos_wifi_client_err_t otherwise. Note that the ESP WiFi driver cannot scan while connecting to a network.
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_scan_stream(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_cancel, aos_future_t *in_future, uint32_t out_err)
+    /**
+     * @brief Cancel a pending request
+     *
+     * Applies to aos_wifi_client_connect, aos_wifi_client_connect_best, aos_wifi_client_connect_list,
+     * aos_wifi_client_wait_connected, aos_wifi_client_scan and aos_wifi_client_scan_stream requests not resolved yet, which are resolved with
+     * out_err = AOS_WIFI_CLIENT_ERR_CANCELLED. Radio work is only stopped if no other request depends on it: a scan
+     * keeps running for the other requests it serves, and an association attempt is kept for identical connection
+     * requests joined to it. Otherwise the scan is stopped, or the connection attempt abandoned and the client left
+     * disconnected.
+     *
+     * @note Requests are handled in order, thus the request must have been sent before the cancellation. The cancelled
+     * future must stay allocated until the cancellation is resolved.
+     *
+     * @param future Future
+     * @param in_future (on future) Future of the request to cancel
+     * @param out_err (on future) 0 if cancelled, AOS_WIFI_CLIENT_ERR_FAIL if not pending (e.g. already resolved)
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_cancel(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_roam_stats_get, aos_wifi_client_roam_stats_t out_stats)
+    /**
+     * @brief Get roaming counters
+     *
+     * @param future Future
+     * @param out_stats (on future) Roaming counters
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_roam_stats_get(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_event_stats_get, aos_wifi_client_event_stats_t out_stats)
+    /**
+     * @brief Get driver event handler counters
+     *
+     * @note Only the events the client subscribed to are counted, see CONFIG_AOS_WIFI_CLIENT_EVENT_ANY.
+     *
+     * @param future Future
+     * @param out_stats (on future) Event handler counters
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_event_stats_get(aos_future_t *future);
+
+    AOS_DECLARE(aos_wifi_client_get_stats, aos_wifi_client_stats_t out_stats, uint32_t out_err)
+    /**
+     * @brief Get a snapshot of the runtime statistics
+     *
+     * @param future Future
+     * @param out_stats (on future) Statistics
+     * @param out_err (on future) 0 if success, 1 if statistics are disabled (CONFIG_AOS_WIFI_CLIENT_STATS)
+     * @return aos_future_t* Same future as input
+     */
+    aos_future_t *aos_wifi_client_get_stats(aos_future_t *future);
+
+    /**
+     * @brief Read the connection status without going through the client task
+     *
+     * Never sends messages, so it can be polled from any task or from an ISR. The snapshot is published by the client
+     * task on every change and read under a sequence counter, it is consistent as a whole. When the read overlaps a
+     * publication, it is retried a few times: from a task, after a one tick delay that lets a preempted client task
+     * finish, from an ISR, right away.
+     *
+     * @note Every caller must handle a false return, retries are bounded.
+     *
+     * @param status Status
+     * @return true if success, false if the client task kept publishing new snapshots (retry later)
+     */
+    bool aos_wifi_client_status_get(aos_wifi_client_status_t *status);
+
+    /**
+     * @brief Forget the DHCP lease persisted across deep sleep, e.g. after detecting an address conflict
+     *
+     * The next connection goes through DHCP. The current one, if any, is not affected. Does nothing unless
+     * CONFIG_AOS_WIFI_CLIENT_RESUME is enabled. Can be called from any task.
+     */
+    void aos_wifi_client_resume_invalidate(void);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+/**
+ * @file aos_wifi_client_driver.h
+ * @author Michele Riva (michele.riva@protonmail.com)
+ * @brief AOS WiFi client driver interface
+ * @version 0.9.0
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+#include <esp_wifi.h>
+#include <esp_netif.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief WiFi driver operations used by the client
+     *
+     * Operations mirror the esp_wifi_* functions of the same name and must behave alike, including posting WIFI_EVENT
+     * and IP_EVENT events to the default event loop. Only station mode is used.
+     */
+    typedef struct aos_wifi_client_driver_t
+    {
+        esp_err_t (*init)(void); // Initialize the driver, NVS must not be used
+        esp_err_t (*deinit)(void);
+        esp_netif_t *(*netif_create)(void); // Create the station network interface
+        void (*netif_destroy)(esp_netif_t *netif);
+        esp_err_t (*set_mode)(wifi_mode_t mode);
+        esp_err_t (*set_ps)(wifi_ps_type_t type);
+        esp_err_t (*set_event_mask)(uint32_t mask);
+        esp_err_t (*get_event_mask)(uint32_t *mask);
+        esp_err_t (*start)(void);
+        esp_err_t (*stop)(void);
+        esp_err_t (*connect)(void);
+        esp_err_t (*disconnect)(void);
+        esp_err_t (*get_config)(wifi_interface_t interface, wifi_config_t *config);
+        esp_err_t (*set_config)(wifi_interface_t interface, wifi_config_t *config);
+        esp_err_t (*scan_start)(const wifi_scan_config_t *config, bool block);
+        esp_err_t (*scan_stop)(void);
+        esp_err_t (*scan_get_ap_num)(uint16_t *number);
+        esp_err_t (*scan_get_ap_records)(uint16_t *number, wifi_ap_record_t *records);
+        esp_err_t (*scan_get_ap_record)(wifi_ap_record_t *record); // Optional, records are fetched all at once if NULL
+        esp_err_t (*clear_ap_list)(void);                          // Optional, records are freed through scan_get_ap_records if NULL
+        esp_err_t (*sta_get_ap_info)(wifi_ap_record_t *record);
+        esp_err_t (*set_rssi_threshold)(int32_t rssi);
+        esp_err_t (*static_ip_set)(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info); // Optional, NULL ip_info restores DHCP
+    } aos_wifi_client_driver_t;
+
+#if !CONFIG_IDF_TARGET_LINUX
+    /**
+     * @brief ESP WiFi driver, default on chip targets
+     */
+    extern const aos_wifi_client_driver_t aos_wifi_client_driver_esp;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file aos_wifi_client_sim.h
+ * @author Michele Riva (michele.riva@protonmail.com)
+ * @brief AOS WiFi client simulated driver
+ * @version 0.9.0
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#pragma once
+#include <aos_wifi_client_driver.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define AOS_WIFI_CLIENT_SIM_APS 16 // Maximum number of simulated access points
+
+    /**
+     * @brief Simulated access point
+     */
+    typedef struct aos_wifi_client_sim_ap_t
+    {
+        const char *ssid;      // SSID
+        const char *password;  // Password, NULL or empty for open networks
+        uint8_t bssid[6];      // BSSID, must be unique
+        uint8_t channel;       // Channel (1-13)
+        int8_t rssi;           // Signal strength as seen by the station
+        bool hidden;           // Not broadcasting its SSID, only found by targeted scans
+        uint8_t reject_reason; // If not 0, association is refused with this wifi_err_reason_t
+    } aos_wifi_client_sim_ap_t;
+
+    /**
+     * @brief Simulation script
+     *
+     * Delays are simulated with FreeRTOS timers, so runs are deterministic for a given script.
+     */
+    typedef struct aos_wifi_client_sim_config_t
+    {
+        const aos_wifi_client_sim_ap_t *aps; // Access points, copied
+        size_t aps_count;                    // Number of access points, up to AOS_WIFI_CLIENT_SIM_APS
+        unsigned int scan_duration_ms;       // Duration of a full scan, single channel scans take 1/13 of it
+        unsigned int connect_duration_ms;    // Time from connect to association (or failure)
+        unsigned int dhcp_delay_ms;          // Time from association to IP_EVENT_STA_GOT_IP
+    } aos_wifi_client_sim_config_t;
+
+    /**
+     * @brief Simulated WiFi driver, default on the linux target
+     *
+     * Events are posted to the default event loop, as the ESP WiFi driver does.
+     */
+    extern const aos_wifi_client_driver_t aos_wifi_client_driver_sim;
+
+    /**
+     * @brief Set the simulation script
+     *
+     * Should be called before the driver is started. The current link, if any, is kept.
+     *
+     * @param config Script
+     * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if there are too many access points
+     */
+    esp_err_t aos_wifi_client_sim_setup(const aos_wifi_client_sim_config_t *config);
+
+    /**
+     * @brief Change an access point at runtime
+     *
+     * Changing the RSSI of the AP the station is associated to triggers WIFI_EVENT_STA_BSS_RSSI_LOW if it crosses the
+     * threshold set through set_rssi_threshold.
+     *
+     * @param index Index of the access point in the script
+     * @param ap New access point settings
+     * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_ARG if index is out of range
+     */
+    esp_err_t aos_wifi_client_sim_ap_set(size_t index, const aos_wifi_client_sim_ap_t *ap);
+
+    /**
+     * @brief Drop the current link, as if the AP went away
+     *
+     * @param reason Reason reported in WIFI_EVENT_STA_DISCONNECTED
+     * @return esp_err_t ESP_OK on success, ESP_ERR_INVALID_STATE if not associated
+     */
+    esp_err_t aos_wifi_client_sim_link_drop(uint8_t reason);
+
+#ifdef __cplusplus
+}
+#endif
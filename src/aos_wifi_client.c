@@ -21,11 +21,20 @@
  *
  * TODO:
  * - Ensure country info and channels are handled automatically (there's some logic already behind the hood)
- * - Could be interesting to use esp_wifi_set_event_mask(uint32_t mask) to save some calls from events
  */
 #include <aos_wifi_client.h>
+#include <aos_wifi_client_driver.h>
+#include <aos_wifi_client_sim.h>
 #include <string.h>
 #include <esp_wifi.h>
+#include <esp_random.h>
+#include <esp_idf_version.h>
+#include <esp_timer.h>
+#include <esp_attr.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
 #include <sdkconfig.h>
 #ifdef CONFIG_AOS_WIFI_CLIENT_LOG_NONE
 #define LOG_LOCAL_LEVEL ESP_LOG_NONE
@@ -42,6 +51,11 @@
 #endif
 #include <esp_log.h>
 
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATIC
+// AsyncRTOS owns these allocations, they only happen once, in aos_wifi_client_init
+#pragma message("CONFIG_AOS_WIFI_CLIENT_STATIC: the AsyncRTOS task (stack, queue) and event pool futures are heap allocated by aos_wifi_client_init")
+#endif
+
 typedef enum
 {
     AOS_WIFI_CLIENT_EVT_CONFIG_SET,
@@ -50,52 +64,509 @@ typedef enum
     AOS_WIFI_CLIENT_EVT_SCAN,
     AOS_WIFI_CLIENT_EVT_CONNECTED,
     AOS_WIFI_CLIENT_EVT_DISCONNECTED,
-    AOS_WIFI_CLIENT_EVT_SCANDONE
+    AOS_WIFI_CLIENT_EVT_SCANDONE,
+    AOS_WIFI_CLIENT_EVT_RETRY,
+    AOS_WIFI_CLIENT_EVT_SET_POWER_MODE,
+    AOS_WIFI_CLIENT_EVT_SCAN_STREAM,
+    AOS_WIFI_CLIENT_EVT_NETWORK_ADD,
+    AOS_WIFI_CLIENT_EVT_NETWORK_REMOVE,
+    AOS_WIFI_CLIENT_EVT_CONNECT_BEST,
+    AOS_WIFI_CLIENT_EVT_CONNECT_LIST,
+    AOS_WIFI_CLIENT_EVT_RSSI_LOW,
+    AOS_WIFI_CLIENT_EVT_ROAM,
+    AOS_WIFI_CLIENT_EVT_ROAM_STATS_GET,
+    AOS_WIFI_CLIENT_EVT_EVENT_STATS_GET,
+    AOS_WIFI_CLIENT_EVT_GET_STATS,
+    AOS_WIFI_CLIENT_EVT_WAIT_CONNECTED,
+    AOS_WIFI_CLIENT_EVT_DEADLINE,
+    AOS_WIFI_CLIENT_EVT_SUBSCRIBE,
+    AOS_WIFI_CLIENT_EVT_CANCEL,
+    AOS_WIFI_CLIENT_EVT_LINK_SAMPLE,
+    AOS_WIFI_CLIENT_EVT_LANE,
+    AOS_WIFI_CLIENT_EVT_MAX
 } _aos_wifi_client_evt_t;
 
 typedef enum
 {
-    AOS_WIFI_CLIENT_STATE_DISCONNECTED,
-    AOS_WIFI_CLIENT_STATE_CONNECTING,
-    AOS_WIFI_CLIENT_STATE_CONNECTED,
-    AOS_WIFI_CLIENT_STATE_RECONNECTING,
-} _aos_wifi_client_state_t;
+    AOS_WIFI_CLIENT_POLICY_BACKOFF,   // Transient or unknown cause, retry according to the backoff policy
+    AOS_WIFI_CLIENT_POLICY_IMMEDIATE, // Link-level hiccup, the AP is likely still there, retry right away
+    AOS_WIFI_CLIENT_POLICY_FAILFAST,  // Configuration rejected by the AP, retrying will not help
+} _aos_wifi_client_policy_t;
+
+/**
+ * WiFi driver disconnection reason policies. Fail-fast reasons only apply to connection requests, as credentials
+ * already proven valid may fail transiently (e.g. handshake timeouts on weak links) while recovering a connection.
+ * Unlisted reasons default to AOS_WIFI_CLIENT_POLICY_BACKOFF.
+ */
+static const struct
+{
+    uint8_t reason;
+    _aos_wifi_client_policy_t policy;
+} _aos_wifi_client_policies[] = {
+    {WIFI_REASON_UNSPECIFIED, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_AUTH_EXPIRE, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_AUTH_LEAVE, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_ASSOC_EXPIRE, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_ASSOC_TOOMANY, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_NOT_AUTHED, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_NOT_ASSOCED, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_ASSOC_LEAVE, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_ASSOC_NOT_AUTHED, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_DISASSOC_PWRCAP_BAD, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_DISASSOC_SUPCHAN_BAD, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_IE_INVALID, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_MIC_FAILURE, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_IE_IN_4WAY_DIFFERS, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_GROUP_CIPHER_INVALID, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_PAIRWISE_CIPHER_INVALID, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_AKMP_INVALID, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_UNSUPP_RSN_IE_VERSION, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_INVALID_RSN_IE_CAP, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_802_1X_AUTH_FAILED, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_CIPHER_SUITE_REJECTED, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_INVALID_PMKID, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_BEACON_TIMEOUT, AOS_WIFI_CLIENT_POLICY_IMMEDIATE},
+    {WIFI_REASON_NO_AP_FOUND, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_AUTH_FAIL, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_ASSOC_FAIL, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+    {WIFI_REASON_HANDSHAKE_TIMEOUT, AOS_WIFI_CLIENT_POLICY_FAILFAST},
+    {WIFI_REASON_CONNECTION_FAIL, AOS_WIFI_CLIENT_POLICY_BACKOFF},
+};
+
+typedef struct _aos_wifi_client_hint_t
+{
+    bool valid;
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    wifi_auth_mode_t authmode;
+} _aos_wifi_client_hint_t;
+
+typedef union _aos_wifi_client_notification_data_t
+{
+    struct
+    {
+        uint8_t reason;
+        int8_t rssi;
+    } disconnected;
+    esp_netif_ip_info_t ip_info;
+    uint32_t retry_seq;
+    int32_t rssi;
+} _aos_wifi_client_notification_data_t;
+
+/**
+ * Preallocated futures used to forward driver and timer notifications to the client task without allocating.
+ * Pooled futures are never resolved, they go back to the pool once handled. Notifications which find the pool empty
+ * are kept (latest per type) and replayed by the client task as soon as a future is released. Those which could not be
+ * sent are kept alike and resent by the timer, a future may never be released otherwise.
+ */
+typedef struct _aos_wifi_client_pool_t
+{
+    aos_future_t *futures[CONFIG_AOS_WIFI_CLIENT_EVENT_POOLSIZE];
+    uint32_t free_mask;
+    uint32_t lost_mask;
+    uint32_t lost_seq[AOS_WIFI_CLIENT_EVT_MAX];
+    _aos_wifi_client_notification_data_t lost[AOS_WIFI_CLIENT_EVT_MAX];
+    uint32_t seq;
+    unsigned int exhausted;
+    portMUX_TYPE lock;
+#ifndef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    TimerHandle_t timer; // Resends the oldest kept notification after a failed send
+    StaticTimer_t timer_buffer;
+#endif
+} _aos_wifi_client_pool_t;
+
+/**
+ * Driver events and timer notifications waiting for the client task (CONFIG_AOS_WIFI_CLIENT_EVENT_LANE). The event
+ * loop and the timer service task only store the latest event of each type here and rings a doorbell, a pool future sent only when the queue has room, the client task
+ * handles pending events in arrival order before any queued request. A doorbell that could not be sent is rung again
+ * by the next event or by the retry timer. Protected by the pool lock.
+ */
+typedef struct _aos_wifi_client_lane_t
+{
+    uint32_t pending_mask;
+    uint32_t seq[AOS_WIFI_CLIENT_EVT_MAX];
+    _aos_wifi_client_notification_data_t data[AOS_WIFI_CLIENT_EVT_MAX];
+    uint32_t next_seq;
+    bool doorbell; // Wake-up on its way to the client task
+    TimerHandle_t timer; // Rings again after a doorbell could not be sent
+    StaticTimer_t timer_buffer;
+} _aos_wifi_client_lane_t;
+
+#define _AOS_WIFI_CLIENT_WAKE_RETRY_MS 10 // Delay before waking the client task again when the queue or the pool was full
+
+typedef struct _aos_wifi_client_scan_spec_t
+{
+    uint8_t ssid[33];
+    uint8_t bssid[6];
+    bool bssid_set;
+    uint8_t channel;
+    uint16_t channel_bitmap;
+    bool passive;
+    uint16_t min_dwell_ms;
+    uint16_t max_dwell_ms;
+    bool show_hidden;
+} _aos_wifi_client_scan_spec_t;
+
+typedef enum
+{
+    AOS_WIFI_CLIENT_SCAN_RESULTS,    // aos_wifi_client_scan, results copied to an array
+    AOS_WIFI_CLIENT_SCAN_STREAM,     // aos_wifi_client_scan_stream, results passed to a callback
+    AOS_WIFI_CLIENT_SCAN_CANDIDATES, // aos_wifi_client_connect_best, results ranked against known networks
+    AOS_WIFI_CLIENT_SCAN_ROAM,       // Background roaming scan, no future
+} _aos_wifi_client_scan_kind_t;
+
+typedef struct _aos_wifi_client_scan_waiter_t
+{
+    aos_future_t *future;
+    _aos_wifi_client_scan_kind_t kind;
+    bool active;      // Served by the running scan, otherwise queued
+    int64_t deadline; // 0 if none, only application requests have one
+    _aos_wifi_client_scan_spec_t spec;
+    aos_wifi_client_scan_result_t *results;
+    size_t results_size;
+    aos_wifi_client_scan_cb_t callback;
+    void *arg;
+    size_t count;
+    bool done;
+} _aos_wifi_client_scan_waiter_t;
+
+typedef struct _aos_wifi_client_scan_cache_t
+{
+    aos_wifi_client_scan_result_t results[CONFIG_AOS_WIFI_CLIENT_SCAN_CACHE_SIZE];
+    size_t count;
+    int64_t timestamp;
+    bool valid;
+} _aos_wifi_client_scan_cache_t;
+
+typedef struct _aos_wifi_client_network_t
+{
+    char ssid[33];
+    char password[65];
+    uint8_t priority;
+} _aos_wifi_client_network_t;
+
+typedef struct _aos_wifi_client_fallback_t
+{
+    char ssid[33];
+    char password[65];
+    unsigned int attempts; // 0 for connection_attempts
+} _aos_wifi_client_fallback_t;
+
+typedef enum
+{
+    AOS_WIFI_CLIENT_CONNECT_SINGLE, // aos_wifi_client_connect
+    AOS_WIFI_CLIENT_CONNECT_BEST,   // aos_wifi_client_connect_best, walks candidates
+    AOS_WIFI_CLIENT_CONNECT_LIST,   // aos_wifi_client_connect_list, walks fallbacks
+} _aos_wifi_client_connect_kind_t;
+
+typedef struct _aos_wifi_client_candidate_t
+{
+    uint8_t network;
+    float strength;
+} _aos_wifi_client_candidate_t;
+
+typedef struct _aos_wifi_client_roam_t
+{
+    TimerHandle_t timer;
+    int64_t associated_at;
+    int64_t started_at;
+    bool scanning;
+    bool in_progress;
+    bool left;
+    uint8_t bssid[6];
+    aos_wifi_client_scan_result_t best;
+    bool best_valid;
+    _aos_wifi_client_hint_t prev_hint;
+    aos_wifi_client_roam_stats_t stats;
+} _aos_wifi_client_roam_t;
+
+#define _AOS_WIFI_CLIENT_LINK_ALPHA 0.25f // Default weight of a new RSSI sample
+
+typedef struct _aos_wifi_client_link_t
+{
+    TimerHandle_t timer;
+    unsigned int samples; // Since the last association
+    int64_t sampled_at;
+    float avg;
+    float trend;
+    bool degraded;
+} _aos_wifi_client_link_t;
+
+typedef struct _aos_wifi_client_stats_t
+{
+    aos_wifi_client_stats_t stats;
+    int64_t state_since;
+    int64_t connect_since;
+    int64_t scan_since;
+} _aos_wifi_client_stats_t;
+
+typedef struct _aos_wifi_client_subscriber_t
+{
+    QueueHandle_t queue;
+    uint32_t mask;
+    uint32_t dropped;
+} _aos_wifi_client_subscriber_t;
+
+/**
+ * Association and DHCP lease kept across deep sleep (CONFIG_AOS_WIFI_CLIENT_RESUME), zeroed on power-on
+ */
+typedef struct _aos_wifi_client_resume_t
+{
+    _aos_wifi_client_hint_t hint;
+    esp_netif_ip_info_t lease;
+    time_t lease_time; // When DHCP handed the lease out
+    bool lease_valid;
+} _aos_wifi_client_resume_t;
+
+/**
+ * Link request (connect or disconnect) not applied to the driver yet. Requests handled while more are queued behind
+ * them only update this, the net effect is applied once, before the next request of any other kind is handled.
+ */
+typedef struct _aos_wifi_client_intent_t
+{
+    bool pending;
+    bool connect;
+    char ssid[33]; // Network targeted by connect_future, kept once applied to match identical requests
+    char password[65];
+} _aos_wifi_client_intent_t;
+
+// Future resolved with AOS_WIFI_CLIENT_ERR_TIMEOUT once its deadline passes
+typedef struct _aos_wifi_client_timed_future_t
+{
+    aos_future_t *future;
+    int64_t deadline; // 0 if none
+} _aos_wifi_client_timed_future_t;
+
+// Single writer seqlock, odd sequence while the client task is writing
+typedef struct _aos_wifi_client_status_t
+{
+    uint32_t seq;
+    aos_wifi_client_status_t status;
+} _aos_wifi_client_status_t;
+
+#define _AOS_WIFI_CLIENT_STATUS_RETRIES 4 // Readers give up after this, the writer may be preempted by them
+
+#define _AOS_WIFI_CLIENT_WIFI_EVENTS 3 // Maximum number of WIFI_EVENT ids subscribed to
 
 typedef struct _aos_wifi_client_ctx_t
 {
     aos_wifi_client_config_t config;
-    _aos_wifi_client_state_t state;
+    aos_wifi_client_state_t state;
+    _aos_wifi_client_hint_t hint;
+    bool fastpath;
+    bool leaving; // Link reset by us, the driver still has to report it with ASSOC_LEAVE
     esp_netif_t *netif;
     esp_event_handler_instance_t ip_handler_instance;
-    esp_event_handler_instance_t wifi_handler_instance;
+    esp_event_handler_instance_t wifi_handler_instances[_AOS_WIFI_CLIENT_WIFI_EVENTS];
+    int32_t wifi_event_ids[_AOS_WIFI_CLIENT_WIFI_EVENTS];
+    size_t wifi_events_count;
+    uint32_t wifi_event_mask; // Driver event mask found on start, restored on stop
+    bool wifi_event_mask_set;
+    aos_wifi_client_event_stats_t event_stats;
     aos_future_t *connect_future;
-    aos_future_t *scan_future;
-    esp_netif_ip_info_t *ip_info;
+    int64_t connect_deadline; // 0 if none
+    _aos_wifi_client_connect_kind_t connect_kind;
+    _aos_wifi_client_timed_future_t connect_joined[CONFIG_AOS_WIFI_CLIENT_CONNECT_JOINED]; // Identical requests resolved with connect_future
+    size_t connect_joined_count;
+    _aos_wifi_client_intent_t intent;
+    uint32_t queued;
+    aos_future_t *best_future;
+    _aos_wifi_client_timed_future_t connected_waiters[CONFIG_AOS_WIFI_CLIENT_CONNECTED_WAITERS];
+    size_t connected_waiters_count;
+    TimerHandle_t deadline_timer;
+    _aos_wifi_client_subscriber_t subscribers[CONFIG_AOS_WIFI_CLIENT_SUBSCRIBERS];
+    size_t subscribers_count;
+    _aos_wifi_client_network_t networks[CONFIG_AOS_WIFI_CLIENT_NETWORKS];
+    size_t networks_count;
+    _aos_wifi_client_candidate_t candidates[CONFIG_AOS_WIFI_CLIENT_NETWORKS];
+    size_t candidates_count;
+    size_t candidate; // Index in candidates or fallbacks, depending on connect_kind
+    _aos_wifi_client_fallback_t fallbacks[CONFIG_AOS_WIFI_CLIENT_FALLBACKS];
+    size_t fallbacks_count;
+    _aos_wifi_client_scan_waiter_t scan_waiters[CONFIG_AOS_WIFI_CLIENT_SCAN_WAITERS];
+    size_t scan_waiters_count;
+    bool scanning;
+    _aos_wifi_client_scan_spec_t scan_spec;
+    _aos_wifi_client_scan_cache_t scan_cache;
+    esp_netif_ip_info_t ip_info;
+    bool lease_reused;   // The persisted lease is applied as a static address
+    bool boot_reported;  // Time to the first IP address since boot logged
+    aos_wifi_client_status_t status; // Next snapshot to publish, only touched by the client task
     unsigned int connection_attempt;
+    unsigned int connection_budget; // Attempts allowed on the network being connected
     unsigned int reconnection_attempt;
+    StaticTimer_t timer_buffers[4]; // Retry, roaming, deadline and link monitor timers
+    TimerHandle_t retry_timer;
+    uint32_t retry_seq;
+    bool retry_pending;
+    _aos_wifi_client_roam_t roam;
+    _aos_wifi_client_link_t link;
+    _aos_wifi_client_pool_t pool;
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_lane_t lane;
+#endif
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    _aos_wifi_client_stats_t stats;
+#endif
 } _aos_wifi_client_ctx_t;
 
 static uint32_t _aos_wifi_client_onstart(aos_task_t *task, aos_future_t *future);
 static uint32_t _aos_wifi_client_onstop(aos_task_t *task, aos_future_t *future);
 static void _aos_wifi_client_connect_handler(aos_task_t *task, aos_future_t *future);
 static void _aos_wifi_client_disconnect_handler(aos_task_t *task, aos_future_t *future);
-static void _aos_wifi_client_onconnected_handler(aos_task_t *task, aos_future_t *future);
-static void _aos_wifi_client_ondisconnected_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_intent_apply(aos_task_t *task);
+static void _aos_wifi_client_connect_apply(aos_task_t *task);
+static void _aos_wifi_client_wait_connected_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_ondeadline(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_connected_waiters_resolve(aos_task_t *task, uint32_t err);
+static void _aos_wifi_client_deadline_arm(_aos_wifi_client_ctx_t *ctx);
+static int64_t _aos_wifi_client_deadline(unsigned int timeout_ms);
+static int64_t _aos_wifi_client_deadline_min(int64_t a, int64_t b);
+static void _aos_wifi_client_connect_expire(aos_task_t *task, int64_t now);
+static void _aos_wifi_client_connect_drop(aos_task_t *task, uint32_t err);
+static void _aos_wifi_client_deadline_timer_cb(TimerHandle_t timer);
+static void _aos_wifi_client_subscribe_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_cancel_handler(aos_task_t *task, aos_future_t *future);
+static bool _aos_wifi_client_cancel(aos_task_t *task, aos_future_t *target);
+static void _aos_wifi_client_notify(_aos_wifi_client_ctx_t *ctx, aos_wifi_client_event_t event, void *args);
 static void _aos_wifi_client_scan_handler(aos_task_t *task, aos_future_t *future);
-static void _aos_wifi_client_onscandone_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_scan_stream_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_notification_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_onconnected(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_ondisconnected(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_onscandone(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_onretry(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_onroam(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_roam_stats_get_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_roam_arm(_aos_wifi_client_ctx_t *ctx);
+static void _aos_wifi_client_roam_schedule(_aos_wifi_client_ctx_t *ctx, unsigned int delay_ms);
+static bool _aos_wifi_client_roam_candidate(const aos_wifi_client_scan_result_t *result, void *arg);
+static void _aos_wifi_client_roam_evaluate(aos_task_t *task, uint32_t err);
+static void _aos_wifi_client_roam_timer_cb(TimerHandle_t timer);
+static void _aos_wifi_client_roam_scan(aos_task_t *task, const wifi_ap_record_t *ap);
+static void _aos_wifi_client_onlinksample(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_link_start(_aos_wifi_client_ctx_t *ctx);
+static void _aos_wifi_client_link_timer_cb(TimerHandle_t timer);
+static void _aos_wifi_client_set_power_mode_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_network_add_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_network_remove_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_connect_best_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_connect_list_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_connect_output(_aos_wifi_client_ctx_t *ctx, uint32_t err, bool fastpath);
+static esp_err_t _aos_wifi_client_connect_start(aos_task_t *task, const char *ssid, const char *password);
+static void _aos_wifi_client_connect_resolve(aos_task_t *task, uint32_t err);
+static void _aos_wifi_client_connect_failed(aos_task_t *task, uint32_t err);
+static bool _aos_wifi_client_candidate_add(const aos_wifi_client_scan_result_t *result, void *arg);
+static void _aos_wifi_client_candidates_ready(aos_task_t *task, aos_future_t *future, int64_t deadline);
+static bool _aos_wifi_client_candidate_next(aos_task_t *task);
+static int _aos_wifi_client_network_find(_aos_wifi_client_ctx_t *ctx, const char *ssid);
 static void _aos_wifi_client_disconnect(aos_task_t *task);
+static void _aos_wifi_client_link_reset(aos_task_t *task);
 static void _aos_wifi_client_stopcurrentscan(aos_task_t *task);
+static void _aos_wifi_client_scan_start(aos_task_t *task, aos_future_t *future, _aos_wifi_client_scan_kind_t kind);
+static void _aos_wifi_client_scan_next(aos_task_t *task);
+static void _aos_wifi_client_scan_resolve(aos_task_t *task, uint32_t err);
+static void _aos_wifi_client_scan_expire(aos_task_t *task, int64_t now);
+static void _aos_wifi_client_scan_orphaned(aos_task_t *task);
+static void _aos_wifi_client_scan_spec_set(_aos_wifi_client_scan_spec_t *spec, const aos_wifi_client_scan_spec_t *in_spec);
+static bool _aos_wifi_client_scan_spec_isdefault(const _aos_wifi_client_scan_spec_t *spec);
+static bool _aos_wifi_client_scan_waiter_deliver(_aos_wifi_client_scan_waiter_t *waiter, const aos_wifi_client_scan_result_t *result);
+static void _aos_wifi_client_scan_waiter_resolve(aos_task_t *task, _aos_wifi_client_scan_waiter_t *waiter, uint32_t err);
+static esp_err_t _aos_wifi_client_scan_foreach(bool (*callback)(const wifi_ap_record_t *record, void *arg), void *arg);
+static esp_err_t _aos_wifi_client_scan_clear(void);
+static void _aos_wifi_client_scan_result_from_record(const wifi_ap_record_t *record, aos_wifi_client_scan_result_t *result);
+static esp_err_t _aos_wifi_client_retry(aos_task_t *task, unsigned int attempt, bool immediate);
+static _aos_wifi_client_policy_t _aos_wifi_client_policy_get(uint8_t reason);
+static wifi_ps_type_t _aos_wifi_client_ps_get(aos_wifi_client_power_mode_t mode);
+static uint32_t _aos_wifi_client_backoff_delay(const aos_wifi_client_backoff_t *backoff, unsigned int attempt);
+static void _aos_wifi_client_retry_timer_cb(TimerHandle_t timer);
+static bool _aos_wifi_client_hint_apply(_aos_wifi_client_ctx_t *ctx, wifi_config_t *config);
+static esp_err_t _aos_wifi_client_hint_set(_aos_wifi_client_ctx_t *ctx, bool use);
+static void _aos_wifi_client_hint_store(_aos_wifi_client_ctx_t *ctx);
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+static void _aos_wifi_client_lease_apply(_aos_wifi_client_ctx_t *ctx, const char *ssid);
+static void _aos_wifi_client_lease_drop(_aos_wifi_client_ctx_t *ctx);
+#endif
+#ifndef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+static void _aos_wifi_client_forward(_aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data, bool wait);
+static void _aos_wifi_client_pool_timer_cb(TimerHandle_t timer);
+#endif
+static void _aos_wifi_client_pool_release(aos_task_t *task, uint8_t slot);
+#ifndef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+static void _aos_wifi_client_pool_defer(_aos_wifi_client_pool_t *pool, _aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data);
+#endif
+static void _aos_wifi_client_replay(aos_task_t *task, uint32_t mask, const uint32_t *seq, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_post(_aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_timer_post(_aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data);
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+static void _aos_wifi_client_onlane(aos_task_t *task, const _aos_wifi_client_notification_data_t *data);
+static void _aos_wifi_client_lane_drain(aos_task_t *task);
+static bool _aos_wifi_client_lane_ring(_aos_wifi_client_ctx_t *ctx);
+static void _aos_wifi_client_lane_timer_cb(TimerHandle_t timer);
+#endif
 static void _aos_wifi_client_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data);
+static esp_err_t _aos_wifi_client_events_register(_aos_wifi_client_ctx_t *ctx);
+static void _aos_wifi_client_events_unregister(_aos_wifi_client_ctx_t *ctx);
+static void _aos_wifi_client_event_stats_get_handler(aos_task_t *task, aos_future_t *future);
+static void _aos_wifi_client_get_stats_handler(aos_task_t *task, aos_future_t *future);
+static aos_future_t *_aos_wifi_client_send(_aos_wifi_client_evt_t evt, aos_future_t *future);
+static aos_future_t *_aos_wifi_client_enqueue(_aos_wifi_client_evt_t evt, aos_future_t *future, uint32_t limit);
+static int _aos_wifi_client_pool_take(_aos_wifi_client_ctx_t *ctx);
+static void _aos_wifi_client_state_set(_aos_wifi_client_ctx_t *ctx, aos_wifi_client_state_t state);
+static void _aos_wifi_client_status_publish(_aos_wifi_client_ctx_t *ctx);
+static inline uint32_t _aos_wifi_client_queue_pop(aos_task_t *task);
+static inline void _aos_wifi_client_dequeued(aos_task_t *task);
+static inline void _aos_wifi_client_stats_histogram_add(aos_wifi_client_histogram_t *histogram, int64_t since);
+static inline void _aos_wifi_client_stats_connect_begin(_aos_wifi_client_ctx_t *ctx);
+static inline void _aos_wifi_client_stats_connect_end(_aos_wifi_client_ctx_t *ctx, bool success);
+static inline void _aos_wifi_client_stats_scan_begin(_aos_wifi_client_ctx_t *ctx);
+static inline void _aos_wifi_client_stats_scan_end(_aos_wifi_client_ctx_t *ctx);
+static inline void _aos_wifi_client_stats_attempt(_aos_wifi_client_ctx_t *ctx, bool reconnection);
+static inline void _aos_wifi_client_stats_reason(_aos_wifi_client_ctx_t *ctx, uint8_t reason);
 
 static aos_task_t *_task = NULL;
+static const aos_wifi_client_driver_t *_driver = NULL;
 static const char *_tag = "AOS WiFi client";
+static _aos_wifi_client_status_t _status = {};
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+static RTC_DATA_ATTR _aos_wifi_client_resume_t _resume = {};
+#endif
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATIC
+static _aos_wifi_client_ctx_t _ctx;
+static wifi_ap_record_t _scan_records[CONFIG_AOS_WIFI_CLIENT_STATIC_SCAN_RECORDS]; // Only used by drivers without scan_get_ap_record
+#endif
+
+static void (*const _aos_wifi_client_notification_handlers[AOS_WIFI_CLIENT_EVT_MAX])(aos_task_t *task, const _aos_wifi_client_notification_data_t *data) = {
+    [AOS_WIFI_CLIENT_EVT_CONNECTED] = _aos_wifi_client_onconnected,
+    [AOS_WIFI_CLIENT_EVT_DISCONNECTED] = _aos_wifi_client_ondisconnected,
+    [AOS_WIFI_CLIENT_EVT_SCANDONE] = _aos_wifi_client_onscandone,
+    [AOS_WIFI_CLIENT_EVT_RETRY] = _aos_wifi_client_onretry,
+    [AOS_WIFI_CLIENT_EVT_RSSI_LOW] = _aos_wifi_client_onroam,
+    [AOS_WIFI_CLIENT_EVT_ROAM] = _aos_wifi_client_onroam,
+    [AOS_WIFI_CLIENT_EVT_DEADLINE] = _aos_wifi_client_ondeadline,
+    [AOS_WIFI_CLIENT_EVT_LINK_SAMPLE] = _aos_wifi_client_onlinksample,
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    [AOS_WIFI_CLIENT_EVT_LANE] = _aos_wifi_client_onlane,
+#endif
+};
+
+AOS_DECLARE(_aos_wifi_client_notification, uint8_t slot, uint8_t evt, _aos_wifi_client_notification_data_t data)
+AOS_DEFINE(_aos_wifi_client_notification, uint8_t, uint8_t, _aos_wifi_client_notification_data_t)
 
 void aos_wifi_client_init(aos_wifi_client_config_t *config)
 {
     if (_task)
         return;
 
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATIC
+    _aos_wifi_client_ctx_t *ctx = &_ctx;
+    memset(ctx, 0, sizeof(_aos_wifi_client_ctx_t));
+#else
     _aos_wifi_client_ctx_t *ctx = calloc(1, sizeof(_aos_wifi_client_ctx_t));
+#endif
     aos_task_config_t task_config = {
         .stacksize = CONFIG_AOS_WIFI_CLIENT_TASK_STACKSIZE,
         .queuesize = CONFIG_AOS_WIFI_CLIENT_TASK_QUEUESIZE,
@@ -110,19 +581,81 @@ void aos_wifi_client_init(aos_wifi_client_config_t *config)
         aos_task_handler_set(_task, _aos_wifi_client_connect_handler, AOS_WIFI_CLIENT_EVT_CONNECT) ||
         aos_task_handler_set(_task, _aos_wifi_client_disconnect_handler, AOS_WIFI_CLIENT_EVT_DISCONNECT) ||
         aos_task_handler_set(_task, _aos_wifi_client_scan_handler, AOS_WIFI_CLIENT_EVT_SCAN) ||
-        aos_task_handler_set(_task, _aos_wifi_client_onconnected_handler, AOS_WIFI_CLIENT_EVT_CONNECTED) ||
-        aos_task_handler_set(_task, _aos_wifi_client_ondisconnected_handler, AOS_WIFI_CLIENT_EVT_DISCONNECTED) ||
-        aos_task_handler_set(_task, _aos_wifi_client_onscandone_handler, AOS_WIFI_CLIENT_EVT_SCANDONE))
+        aos_task_handler_set(_task, _aos_wifi_client_scan_stream_handler, AOS_WIFI_CLIENT_EVT_SCAN_STREAM) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_CONNECTED) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_DISCONNECTED) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_SCANDONE) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_RETRY) ||
+        aos_task_handler_set(_task, _aos_wifi_client_set_power_mode_handler, AOS_WIFI_CLIENT_EVT_SET_POWER_MODE) ||
+        aos_task_handler_set(_task, _aos_wifi_client_network_add_handler, AOS_WIFI_CLIENT_EVT_NETWORK_ADD) ||
+        aos_task_handler_set(_task, _aos_wifi_client_network_remove_handler, AOS_WIFI_CLIENT_EVT_NETWORK_REMOVE) ||
+        aos_task_handler_set(_task, _aos_wifi_client_connect_best_handler, AOS_WIFI_CLIENT_EVT_CONNECT_BEST) ||
+        aos_task_handler_set(_task, _aos_wifi_client_connect_list_handler, AOS_WIFI_CLIENT_EVT_CONNECT_LIST) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_RSSI_LOW) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_ROAM) ||
+        aos_task_handler_set(_task, _aos_wifi_client_roam_stats_get_handler, AOS_WIFI_CLIENT_EVT_ROAM_STATS_GET) ||
+        aos_task_handler_set(_task, _aos_wifi_client_event_stats_get_handler, AOS_WIFI_CLIENT_EVT_EVENT_STATS_GET) ||
+        aos_task_handler_set(_task, _aos_wifi_client_get_stats_handler, AOS_WIFI_CLIENT_EVT_GET_STATS) ||
+        aos_task_handler_set(_task, _aos_wifi_client_wait_connected_handler, AOS_WIFI_CLIENT_EVT_WAIT_CONNECTED) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_DEADLINE) ||
+        aos_task_handler_set(_task, _aos_wifi_client_subscribe_handler, AOS_WIFI_CLIENT_EVT_SUBSCRIBE) ||
+        aos_task_handler_set(_task, _aos_wifi_client_cancel_handler, AOS_WIFI_CLIENT_EVT_CANCEL) ||
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_LINK_SAMPLE) ||
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+        aos_task_handler_set(_task, _aos_wifi_client_notification_handler, AOS_WIFI_CLIENT_EVT_LANE) ||
+        !(ctx->lane.timer = xTimerCreateStatic("aos_wifi_lane", pdMS_TO_TICKS(_AOS_WIFI_CLIENT_WAKE_RETRY_MS) + 1, pdFALSE, ctx, _aos_wifi_client_lane_timer_cb, &ctx->lane.timer_buffer)) ||
+#else
+        !(ctx->pool.timer = xTimerCreateStatic("aos_wifi_pool", pdMS_TO_TICKS(_AOS_WIFI_CLIENT_WAKE_RETRY_MS) + 1, pdFALSE, ctx, _aos_wifi_client_pool_timer_cb, &ctx->pool.timer_buffer)) ||
+#endif
+        !(ctx->retry_timer = xTimerCreateStatic("aos_wifi_retry", 1, pdFALSE, ctx, _aos_wifi_client_retry_timer_cb, &ctx->timer_buffers[0])) ||
+        !(ctx->roam.timer = xTimerCreateStatic("aos_wifi_roam", 1, pdFALSE, ctx, _aos_wifi_client_roam_timer_cb, &ctx->timer_buffers[1])) ||
+        !(ctx->deadline_timer = xTimerCreateStatic("aos_wifi_deadline", 1, pdFALSE, ctx, _aos_wifi_client_deadline_timer_cb, &ctx->timer_buffers[2])) ||
+        !(ctx->link.timer = xTimerCreateStatic("aos_wifi_link", 1, pdTRUE, ctx, _aos_wifi_client_link_timer_cb, &ctx->timer_buffers[3])))
         goto wifi_alloc_err;
 
+    // Preallocate notification futures, so that forwarding from the event loop never allocates
+    portMUX_INITIALIZE(&ctx->pool.lock);
+    for (uint8_t i = 0; i < CONFIG_AOS_WIFI_CLIENT_EVENT_POOLSIZE; i++)
+    {
+        ctx->pool.futures[i] = AOS_AWAITABLE_ALLOC_T(_aos_wifi_client_notification)(i, 0, (_aos_wifi_client_notification_data_t){});
+        if (!ctx->pool.futures[i])
+            goto wifi_alloc_err;
+        ctx->pool.free_mask |= 1UL << i;
+    }
+
+#if CONFIG_IDF_TARGET_LINUX
+    _driver = config->driver ? config->driver : &aos_wifi_client_driver_sim;
+#else
+    _driver = config->driver ? config->driver : &aos_wifi_client_driver_esp;
+#endif
     esp_event_loop_create_default(); // This is "sort of" idempotent. Calling again reaches same state, but returns different error.
     ctx->config = *config;
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+    // Waking up from deep sleep, go straight to the last AP
+    if (_resume.hint.valid)
+        ctx->hint = _resume.hint;
+#endif
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    ctx->stats.state_since = esp_timer_get_time();
+#endif
 
     return;
 
 wifi_alloc_err:
     aos_task_free(_task);
+    if (ctx && ctx->retry_timer)
+        xTimerDelete(ctx->retry_timer, 0);
+    if (ctx && ctx->roam.timer)
+        xTimerDelete(ctx->roam.timer, 0);
+    if (ctx && ctx->deadline_timer)
+        xTimerDelete(ctx->deadline_timer, 0);
+    if (ctx && ctx->link.timer)
+        xTimerDelete(ctx->link.timer, 0);
+    for (size_t i = 0; ctx && i < CONFIG_AOS_WIFI_CLIENT_EVENT_POOLSIZE && ctx->pool.futures[i]; i++)
+        aos_awaitable_free(ctx->pool.futures[i]);
+#ifndef CONFIG_AOS_WIFI_CLIENT_STATIC
     free(ctx);
+#endif
     _task = NULL;
 }
 
@@ -137,10 +670,14 @@ static uint32_t _aos_wifi_client_onstart(aos_task_t *task, aos_future_t *future)
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
     AOS_ARGS_T(aos_wifi_client_start) *args = aos_args_get(future);
 
-    wifi_init_config_t wifi_init_config = WIFI_INIT_CONFIG_DEFAULT();
-    wifi_init_config.nvs_enable = 0;
-
-    ctx->netif = esp_netif_create_default_wifi_sta();
+    ctx->leaving = false;
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    ctx->lane.pending_mask = 0;
+    ctx->lane.doorbell = false;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+#endif
+    ctx->netif = _driver->netif_create();
     if (!ctx->netif)
     {
         args->out_err = 1;
@@ -148,12 +685,11 @@ static uint32_t _aos_wifi_client_onstart(aos_task_t *task, aos_future_t *future)
         return 1;
     }
 
-    if (esp_wifi_init(&wifi_init_config) != ESP_OK ||
-        esp_wifi_set_mode(WIFI_MODE_STA) != ESP_OK ||
-        esp_wifi_set_ps(WIFI_PS_NONE) != ESP_OK || // TODO: May improve performance at the expense of power consumption. Make this configurable.
-        esp_wifi_start() != ESP_OK ||
-        esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, _aos_wifi_client_event_handler, NULL, &ctx->ip_handler_instance) != ESP_OK ||
-        esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, _aos_wifi_client_event_handler, NULL, &ctx->wifi_handler_instance) != ESP_OK)
+    if (_driver->init() != ESP_OK ||
+        _driver->set_mode(WIFI_MODE_STA) != ESP_OK ||
+        _driver->set_ps(_aos_wifi_client_ps_get(ctx->config.power.mode)) != ESP_OK ||
+        _driver->start() != ESP_OK ||
+        _aos_wifi_client_events_register(ctx) != ESP_OK)
     {
         args->out_err = 1;
         aos_resolve(future);
@@ -175,31 +711,44 @@ static uint32_t _aos_wifi_client_onstop(aos_task_t *task, aos_future_t *future)
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
     _aos_wifi_client_stopcurrentscan(task);
+    ctx->intent.pending = false;
     _aos_wifi_client_disconnect(task);
+    _aos_wifi_client_connected_waiters_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+    xTimerStop(ctx->deadline_timer, 0);
 
-    esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, ctx->wifi_handler_instance);
-    ctx->wifi_handler_instance = NULL;
-    esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, ctx->ip_handler_instance);
-    ctx->ip_handler_instance = NULL;
+    _aos_wifi_client_events_unregister(ctx);
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    xTimerStop(ctx->lane.timer, 0);
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    ctx->lane.pending_mask = 0;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+#else
+    xTimerStop(ctx->pool.timer, 0);
+#endif
 
-    esp_wifi_stop();
-    esp_wifi_deinit();
+    _driver->stop();
+    _driver->deinit();
 
-    esp_netif_destroy_default_wifi(ctx->netif);
+    _driver->netif_destroy(ctx->netif);
     ctx->netif = NULL;
+    ctx->lease_reused = false; // The persisted lease stays valid, stopping usually precedes deep sleep
 
     aos_resolve(future);
     return 0;
 }
 
-AOS_DEFINE(aos_wifi_client_connect, const char *, const char *, unsigned int)
+AOS_DEFINE(aos_wifi_client_connect, const char *, const char *, unsigned int, unsigned int, bool)
 aos_future_t *aos_wifi_client_connect(aos_future_t *future)
 {
-    return aos_task_send(_task, AOS_WIFI_CLIENT_EVT_CONNECT, future);
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_CONNECT, future);
 }
 static void _aos_wifi_client_connect_handler(aos_task_t *task, aos_future_t *future)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
+    uint32_t queued = _aos_wifi_client_queue_pop(task);
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_lane_drain(task);
+#endif
     AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(future);
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
@@ -221,75 +770,268 @@ static void _aos_wifi_client_connect_handler(aos_task_t *task, aos_future_t *fut
             break;
         }
 
-        // Get current configuration
-        wifi_config_t old_config = {};
-        esp_err_t err = esp_wifi_get_config(ESP_IF_WIFI_STA, &old_config);
-        if (err != ESP_OK)
+        // Join a pending request for the same network, one association attempt serves both
+        if (ctx->connect_future && ctx->connect_kind == AOS_WIFI_CLIENT_CONNECT_SINGLE &&
+            !strcmp(ctx->intent.ssid, args->in_ssid) && !strcmp(ctx->intent.password, args->in_password))
         {
-            ESP_LOGE(_tag, "Could not get current config (ESP_error:%s)", esp_err_to_name(err));
-            _aos_wifi_client_disconnect(task);
-            ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-            args->out_err = 1;
-            aos_resolve(future);
+            if (ctx->connect_joined_count >= CONFIG_AOS_WIFI_CLIENT_CONNECT_JOINED)
+            {
+                ESP_LOGW(_tag, "Too many identical connection requests (max:%u)", CONFIG_AOS_WIFI_CLIENT_CONNECT_JOINED);
+                args->out_err = AOS_WIFI_CLIENT_ERR_BUSY;
+                aos_resolve(future);
+                break;
+            }
+            ESP_LOGD(_tag, "Joining pending connection request (ssid:%s)", args->in_ssid);
+            _aos_wifi_client_timed_future_t *joined = &ctx->connect_joined[ctx->connect_joined_count++];
+            joined->future = future;
+            joined->deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+            if (joined->deadline)
+                _aos_wifi_client_deadline_arm(ctx);
             break;
         }
 
-        // Do not reconnect if configuration did not change
-        if (ctx->state == AOS_WIFI_CLIENT_STATE_CONNECTED &&
-            !strncmp((char *)old_config.sta.ssid, args->in_ssid, sizeof(old_config.sta.ssid) / sizeof(char)) &&
-            !strncmp((char *)old_config.sta.password, args->in_password, sizeof(old_config.sta.password) / sizeof(char)))
-        {
-            ESP_LOGI(_tag, "Already connected to specified network (ssid:%s)", args->in_ssid);
-            args->out_err = 0;
-            aos_resolve(future);
-            break;
-        }
+        // Supersede any pending request, the driver is only touched once the queue has no more link requests
+        _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+        ctx->best_future = NULL;
+        ctx->connect_future = future;
+        ctx->connect_deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+        ctx->connect_kind = AOS_WIFI_CLIENT_CONNECT_SINGLE;
+        if (ctx->connect_deadline)
+            _aos_wifi_client_deadline_arm(ctx);
+        ctx->intent.pending = true;
+        ctx->intent.connect = true;
+        strcpy(ctx->intent.ssid, args->in_ssid);
+        strcpy(ctx->intent.password, args->in_password);
+        if (queued)
+            ESP_LOGD(_tag, "Deferring connection (queued:%u)", queued);
+        else
+            _aos_wifi_client_intent_apply(task);
+        break;
+    }
+    }
+}
+
+static void _aos_wifi_client_intent_apply(aos_task_t *task)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    if (!ctx->intent.pending)
+        return;
+    ctx->intent.pending = false;
+
+    if (ctx->intent.connect)
+    {
+        _aos_wifi_client_connect_apply(task);
+        return;
+    }
+    _aos_wifi_client_disconnect(task);
+    ESP_LOGI(_tag, "Disconnected");
+    _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
+}
+
+static void _aos_wifi_client_connect_apply(aos_task_t *task)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
-        // Disconnect in case we are connected
+    // Get current configuration
+    wifi_config_t old_config = {};
+    esp_err_t err = _driver->get_config(ESP_IF_WIFI_STA, &old_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(_tag, "Could not get current config (ESP_error:%s)", esp_err_to_name(err));
         _aos_wifi_client_disconnect(task);
+        _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
+        return;
+    }
 
-        // Prepare config
-        strcpy((char *)config.sta.ssid, args->in_ssid);
-        strcpy((char *)config.sta.password, args->in_password);
-        err = esp_wifi_set_config(ESP_IF_WIFI_STA, &config);
-        if (err != ESP_OK)
-        {
-            ESP_LOGE(_tag, "Could not set config (ESP_error:%s)", esp_err_to_name(err));
-            _aos_wifi_client_disconnect(task);
-            ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-            args->out_err = 1;
-            aos_resolve(future);
-            break;
-        }
+    // Do not reconnect if configuration did not change, this is also where connect/disconnect/connect sequences end up
+    if (ctx->state == AOS_WIFI_CLIENT_STATE_CONNECTED &&
+        !strncmp((char *)old_config.sta.ssid, ctx->intent.ssid, sizeof(old_config.sta.ssid) / sizeof(char)) &&
+        !strncmp((char *)old_config.sta.password, ctx->intent.password, sizeof(old_config.sta.password) / sizeof(char)))
+    {
+        ESP_LOGI(_tag, "Already connected to specified network (ssid:%s)", ctx->intent.ssid);
+        _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_NONE);
+        return;
+    }
 
-        // Reset state and try to connect
-        ctx->connection_attempt = 0;
-        ctx->reconnection_attempt = 0;
-        err = esp_wifi_connect();
-        if (err != ESP_OK)
+    // Disconnect in case we are connected
+    _aos_wifi_client_link_reset(task);
+    _aos_wifi_client_stats_connect_begin(ctx);
+
+    err = _aos_wifi_client_connect_start(task, ctx->intent.ssid, ctx->intent.password);
+    if (err != ESP_OK)
+    {
+        _aos_wifi_client_disconnect(task);
+        _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
+        return;
+    }
+    _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_CONNECTING);
+}
+
+static esp_err_t _aos_wifi_client_connect_start(aos_task_t *task, const char *ssid, const char *password)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    // Prepare config
+    wifi_config_t config = {};
+    strncpy((char *)config.sta.ssid, ssid, sizeof(config.sta.ssid) / sizeof(char));
+    strncpy((char *)config.sta.password, password, sizeof(config.sta.password) / sizeof(char));
+    config.sta.listen_interval = ctx->config.power.listen_interval;
+    ctx->fastpath = _aos_wifi_client_hint_apply(ctx, &config);
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+    _aos_wifi_client_lease_apply(ctx, ssid);
+#endif
+    esp_err_t err = _driver->set_config(ESP_IF_WIFI_STA, &config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(_tag, "Could not set config (ESP_error:%s)", esp_err_to_name(err));
+        return err;
+    }
+
+    // Reset state and try to connect
+    ctx->connection_attempt = 0;
+    ctx->connection_budget = ctx->config.connection_attempts;
+    if (ctx->connect_future && ctx->connect_kind == AOS_WIFI_CLIENT_CONNECT_LIST && ctx->fallbacks[ctx->candidate].attempts)
+        ctx->connection_budget = ctx->fallbacks[ctx->candidate].attempts;
+    ctx->reconnection_attempt = 0;
+    _aos_wifi_client_stats_attempt(ctx, false);
+    err = _driver->connect();
+    if (err != ESP_OK)
+        ESP_LOGE(_tag, "Could not start connection (%s)", esp_err_to_name(err));
+    return err;
+}
+
+static void _aos_wifi_client_connect_resolve(aos_task_t *task, uint32_t err)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    if (!ctx->connect_future)
+        return;
+    _aos_wifi_client_stats_connect_end(ctx, err == AOS_WIFI_CLIENT_ERR_NONE);
+    _aos_wifi_client_connect_output(ctx, err, ctx->fastpath);
+    aos_resolve(ctx->connect_future);
+    ctx->connect_future = NULL;
+    ctx->connect_deadline = 0;
+    for (size_t i = 0; i < ctx->connect_joined_count; i++)
+    {
+        AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(ctx->connect_joined[i].future);
+        args->out_err = err;
+        args->out_fastpath = ctx->fastpath;
+        aos_resolve(ctx->connect_joined[i].future);
+    }
+    ctx->connect_joined_count = 0;
+}
+
+// Set the outputs of connect_future, whichever request it is
+static void _aos_wifi_client_connect_output(_aos_wifi_client_ctx_t *ctx, uint32_t err, bool fastpath)
+{
+    switch (ctx->connect_kind)
+    {
+    case AOS_WIFI_CLIENT_CONNECT_SINGLE:
+    {
+        AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(ctx->connect_future);
+        args->out_err = err;
+        args->out_fastpath = fastpath;
+        break;
+    }
+    case AOS_WIFI_CLIENT_CONNECT_BEST:
+    {
+        AOS_ARGS_T(aos_wifi_client_connect_best) *args = aos_args_get(ctx->connect_future);
+        args->out_err = err;
+        args->out_fastpath = fastpath;
+        break;
+    }
+    case AOS_WIFI_CLIENT_CONNECT_LIST:
+    {
+        AOS_ARGS_T(aos_wifi_client_connect_list) *args = aos_args_get(ctx->connect_future);
+        args->out_err = err;
+        args->out_index = ctx->candidate;
+        args->out_fastpath = fastpath;
+        break;
+    }
+    }
+}
+
+static void _aos_wifi_client_connect_expire(aos_task_t *task, int64_t now)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    if (!ctx->connect_future)
+        return;
+
+    // Joined requests expire on their own, the association attempt goes on for the others
+    size_t kept = 0;
+    for (size_t i = 0; i < ctx->connect_joined_count; i++)
+    {
+        _aos_wifi_client_timed_future_t *joined = &ctx->connect_joined[i];
+        if (joined->deadline && joined->deadline <= now)
         {
-            ESP_LOGE(_tag, "Could not start connection (%s)", esp_err_to_name(err));
-            _aos_wifi_client_disconnect(task);
-            ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-            args->out_err = 1;
-            aos_resolve(future);
-            break;
+            AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(joined->future);
+            args->out_err = AOS_WIFI_CLIENT_ERR_TIMEOUT;
+            args->out_fastpath = false;
+            aos_resolve(joined->future);
         }
-        ctx->connect_future = future;
-        ctx->state = AOS_WIFI_CLIENT_STATE_CONNECTING;
-        break;
+        else
+            ctx->connect_joined[kept++] = *joined;
+    }
+    ctx->connect_joined_count = kept;
+    if (!ctx->connect_deadline || ctx->connect_deadline > now)
+        return;
+    ESP_LOGW(_tag, "Connection request timed out (ssid:%s)", ctx->intent.ssid);
+    _aos_wifi_client_connect_drop(task, AOS_WIFI_CLIENT_ERR_TIMEOUT);
+}
+
+static void _aos_wifi_client_connect_drop(aos_task_t *task, uint32_t err)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    _aos_wifi_client_connect_output(ctx, err, false);
+    aos_resolve(ctx->connect_future);
+    if (ctx->connect_joined_count)
+    {
+        // The oldest joined request takes over the attempt
+        ESP_LOGI(_tag, "Connection attempt kept for joined requests (count:%u)", (unsigned int)ctx->connect_joined_count);
+        ctx->connect_future = ctx->connect_joined[0].future;
+        ctx->connect_deadline = ctx->connect_joined[0].deadline;
+        memmove(&ctx->connect_joined[0], &ctx->connect_joined[1], --ctx->connect_joined_count * sizeof(ctx->connect_joined[0]));
+        return;
     }
+
+    ctx->connect_future = NULL;
+    ctx->connect_deadline = 0;
+    _aos_wifi_client_stats_connect_end(ctx, false);
+    if (ctx->intent.pending)
+    {
+        // Not applied yet, the driver only sees the net effect
+        ctx->intent.connect = false;
+        return;
     }
+    _aos_wifi_client_link_reset(task);
+    _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
+}
+
+static void _aos_wifi_client_connect_failed(aos_task_t *task, uint32_t err)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    // Fall back to the next known network or list entry without involving the application
+    if (ctx->connect_future && ctx->connect_kind != AOS_WIFI_CLIENT_CONNECT_SINGLE && _aos_wifi_client_candidate_next(task))
+        return;
+    _aos_wifi_client_connect_resolve(task, err);
+    _aos_wifi_client_disconnect(task);
+    _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
 }
 
 AOS_DEFINE(aos_wifi_client_disconnect)
 aos_future_t *aos_wifi_client_disconnect(aos_future_t *future)
 {
-    return aos_task_send(_task, AOS_WIFI_CLIENT_EVT_DISCONNECT, future);
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_DISCONNECT, future);
 }
 static void _aos_wifi_client_disconnect_handler(aos_task_t *task, aos_future_t *future)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
+    uint32_t queued = _aos_wifi_client_queue_pop(task);
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_lane_drain(task);
+#endif
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
     switch (ctx->state)
@@ -299,106 +1041,456 @@ static void _aos_wifi_client_disconnect_handler(aos_task_t *task, aos_future_t *
     case AOS_WIFI_CLIENT_STATE_CONNECTING:
     case AOS_WIFI_CLIENT_STATE_RECONNECTING:
     {
-        _aos_wifi_client_disconnect(task);
-        ESP_LOGI(_tag, "Disconnected");
-        ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
+        // Pending connection requests fail right away, a connection request queued behind may undo the disconnection
+        _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+        ctx->best_future = NULL;
+        ctx->intent.pending = true;
+        ctx->intent.connect = false;
+        if (queued)
+            ESP_LOGD(_tag, "Deferring disconnection (queued:%u)", queued);
+        else
+            _aos_wifi_client_intent_apply(task);
         aos_resolve(future);
         break;
     }
     }
 }
 
-// TODO: Do we have to deal with out-of-sync notifications in case we connect->disconnect->connect quickly in succession? When should we expect them? IDF is not clear.
-AOS_DECLARE(_aos_wifi_client_onconnected, esp_netif_ip_info_t *ip_info)
-AOS_DEFINE(_aos_wifi_client_onconnected, esp_netif_ip_info_t *)
-static void _aos_wifi_client_onconnected_handler(aos_task_t *task, aos_future_t *future)
+AOS_DEFINE(aos_wifi_client_wait_connected, unsigned int, uint32_t)
+aos_future_t *aos_wifi_client_wait_connected(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_WAIT_CONNECTED, future);
+}
+static void _aos_wifi_client_wait_connected_handler(aos_task_t *task, aos_future_t *future)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
-    ESP_LOGI(_tag, "Connected");
+    _aos_wifi_client_dequeued(task);
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
-    AOS_ARGS_T(_aos_wifi_client_onconnected) *args = aos_args_get(future);
+    AOS_ARGS_T(aos_wifi_client_wait_connected) *args = aos_args_get(future);
 
-    switch (ctx->state)
+    if (ctx->state == AOS_WIFI_CLIENT_STATE_CONNECTED)
     {
-    case AOS_WIFI_CLIENT_STATE_CONNECTING:
-    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
-    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+        args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+        aos_resolve(future);
+        return;
+    }
+    if (ctx->connected_waiters_count >= CONFIG_AOS_WIFI_CLIENT_CONNECTED_WAITERS)
     {
-        // Resolve connect future if any
-        if (ctx->connect_future)
-        {
-            AOS_ARGS_T(aos_wifi_client_connect) *connect_future_args = aos_args_get(ctx->connect_future);
-            connect_future_args->out_err = 0;
-            aos_resolve(ctx->connect_future);
-            ctx->connect_future = NULL;
-        }
+        ESP_LOGW(_tag, "Too many tasks waiting for connection (max:%u)", CONFIG_AOS_WIFI_CLIENT_CONNECTED_WAITERS);
+        args->out_err = AOS_WIFI_CLIENT_ERR_BUSY;
+        aos_resolve(future);
+        return;
+    }
 
-        // Reset reconnection counter
-        ctx->reconnection_attempt = 0;
+    _aos_wifi_client_timed_future_t *waiter = &ctx->connected_waiters[ctx->connected_waiters_count++];
+    waiter->future = future;
+    waiter->deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+    if (waiter->deadline)
+        _aos_wifi_client_deadline_arm(ctx);
+}
 
-        // Store ip information
-        ctx->ip_info = args->ip_info; // TODO: Shall we copy them, free them, or just a pointer is fine?
+static void _aos_wifi_client_ondeadline(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
-        // If we are reconnecting, raise event
-        if (ctx->state == AOS_WIFI_CLIENT_STATE_RECONNECTING)
+    // The timer may fire late or after a reschedule, deadlines are what counts
+    int64_t now = esp_timer_get_time();
+    size_t kept = 0;
+    for (size_t i = 0; i < ctx->connected_waiters_count; i++)
+    {
+        _aos_wifi_client_timed_future_t *waiter = &ctx->connected_waiters[i];
+        if (waiter->deadline && waiter->deadline <= now)
         {
-            ctx->config.event_handler(AOS_WIFI_CLIENT_EVENT_RECONNECTED, NULL);
+            AOS_ARGS_T(aos_wifi_client_wait_connected) *args = aos_args_get(waiter->future);
+            args->out_err = AOS_WIFI_CLIENT_ERR_TIMEOUT;
+            aos_resolve(waiter->future);
         }
-
-        // Set state
-        ctx->state = AOS_WIFI_CLIENT_STATE_CONNECTED;
-
-        aos_resolve(future);
-        break;
+        else
+            ctx->connected_waiters[kept++] = *waiter;
     }
-    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    ctx->connected_waiters_count = kept;
+    _aos_wifi_client_connect_expire(task, now);
+    _aos_wifi_client_scan_expire(task, now);
+    _aos_wifi_client_deadline_arm(ctx);
+}
+
+static void _aos_wifi_client_connected_waiters_resolve(aos_task_t *task, uint32_t err)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    if (!ctx->connected_waiters_count)
+        return;
+    ESP_LOGD(_tag, "Resolving connection waiters (count:%u err:%u)", (unsigned int)ctx->connected_waiters_count, err);
+    for (size_t i = 0; i < ctx->connected_waiters_count; i++)
     {
-        // Target state is DISCONNECTED, thus do nothing. It is likely a late notification.
-        aos_resolve(future);
-        break;
+        AOS_ARGS_T(aos_wifi_client_wait_connected) *args = aos_args_get(ctx->connected_waiters[i].future);
+        args->out_err = err;
+        aos_resolve(ctx->connected_waiters[i].future);
     }
+    ctx->connected_waiters_count = 0;
+    _aos_wifi_client_deadline_arm(ctx);
+}
+
+static void _aos_wifi_client_deadline_arm(_aos_wifi_client_ctx_t *ctx)
+{
+    // A single timer serves connection waiters, connection and scan requests, set for the earliest deadline
+    int64_t deadline = 0;
+    for (size_t i = 0; i < ctx->connected_waiters_count; i++)
+        deadline = _aos_wifi_client_deadline_min(deadline, ctx->connected_waiters[i].deadline);
+    if (ctx->connect_future)
+        deadline = _aos_wifi_client_deadline_min(deadline, ctx->connect_deadline);
+    for (size_t i = 0; i < ctx->connect_joined_count; i++)
+        deadline = _aos_wifi_client_deadline_min(deadline, ctx->connect_joined[i].deadline);
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+        deadline = _aos_wifi_client_deadline_min(deadline, ctx->scan_waiters[i].deadline);
+    if (!deadline)
+    {
+        xTimerStop(ctx->deadline_timer, 0);
+        return;
     }
+
+    // Round up, firing early would only cost a useless wake-up
+    int64_t delay_us = deadline - esp_timer_get_time();
+    TickType_t ticks = delay_us > 0 ? pdMS_TO_TICKS((delay_us + 999) / 1000) + 1 : 1;
+    xTimerChangePeriod(ctx->deadline_timer, ticks, 0);
 }
 
-AOS_DECLARE(_aos_wifi_client_ondisconnected, wifi_event_sta_disconnected_t *event)
-AOS_DEFINE(_aos_wifi_client_ondisconnected, wifi_event_sta_disconnected_t *)
-static void _aos_wifi_client_ondisconnected_handler(aos_task_t *task, aos_future_t *future)
+static int64_t _aos_wifi_client_deadline(unsigned int timeout_ms)
 {
-    ESP_LOGD(_tag, "%s", __FUNCTION__);
-    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
-    // AOS_ARGS_T(_aos_wifi_client_ondisconnected) *args = aos_args_get(future);
+    return timeout_ms ? esp_timer_get_time() + timeout_ms * 1000LL : 0;
+}
 
-    switch (ctx->state)
-    {
-    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+// Earliest of two deadlines, 0 meaning none
+static int64_t _aos_wifi_client_deadline_min(int64_t a, int64_t b)
+{
+    return !a || (b && b < a) ? b : a;
+}
+
+static void _aos_wifi_client_deadline_timer_cb(TimerHandle_t timer)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_notification_data_t data = {};
+    _aos_wifi_client_timer_post(AOS_WIFI_CLIENT_EVT_DEADLINE, &data);
+}
+
+AOS_DEFINE(aos_wifi_client_subscribe, QueueHandle_t, uint32_t, uint32_t)
+aos_future_t *aos_wifi_client_subscribe(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_SUBSCRIBE, future);
+}
+static void _aos_wifi_client_subscribe_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    AOS_ARGS_T(aos_wifi_client_subscribe) *args = aos_args_get(future);
+    args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+
+    size_t i = 0;
+    while (i < ctx->subscribers_count && ctx->subscribers[i].queue != args->in_queue)
+        i++;
+
+    if (!args->in_mask)
+    {
+        // Unsubscribe, order does not matter
+        if (i < ctx->subscribers_count)
+            ctx->subscribers[i] = ctx->subscribers[--ctx->subscribers_count];
+    }
+    else if (i < ctx->subscribers_count)
+        ctx->subscribers[i].mask = args->in_mask;
+    else if (!args->in_queue)
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+    else if (ctx->subscribers_count >= CONFIG_AOS_WIFI_CLIENT_SUBSCRIBERS)
+    {
+        ESP_LOGW(_tag, "Too many subscribers (max:%u)", CONFIG_AOS_WIFI_CLIENT_SUBSCRIBERS);
+        args->out_err = AOS_WIFI_CLIENT_ERR_BUSY;
+    }
+    else
+        ctx->subscribers[ctx->subscribers_count++] = (_aos_wifi_client_subscriber_t){.queue = args->in_queue, .mask = args->in_mask};
+
+    aos_resolve(future);
+}
+
+AOS_DEFINE(aos_wifi_client_cancel, aos_future_t *, uint32_t)
+aos_future_t *aos_wifi_client_cancel(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_CANCEL, future);
+}
+static void _aos_wifi_client_cancel_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    AOS_ARGS_T(aos_wifi_client_cancel) *args = aos_args_get(future);
+
+    if (args->in_future && _aos_wifi_client_cancel(task, args->in_future))
+    {
+        args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+        _aos_wifi_client_deadline_arm(ctx);
+    }
+    else
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+    aos_resolve(future);
+}
+
+static bool _aos_wifi_client_cancel(aos_task_t *task, aos_future_t *target)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    if (ctx->connect_future == target)
+    {
+        ESP_LOGI(_tag, "Connection request cancelled (ssid:%s)", ctx->intent.ssid);
+        _aos_wifi_client_connect_drop(task, AOS_WIFI_CLIENT_ERR_CANCELLED);
+        return true;
+    }
+    for (size_t i = 0; i < ctx->connect_joined_count; i++)
+    {
+        if (ctx->connect_joined[i].future != target)
+            continue;
+        memmove(&ctx->connect_joined[i], &ctx->connect_joined[i + 1], (--ctx->connect_joined_count - i) * sizeof(ctx->connect_joined[0]));
+        AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(target);
+        args->out_err = AOS_WIFI_CLIENT_ERR_CANCELLED;
+        args->out_fastpath = false;
+        aos_resolve(target);
+        return true;
+    }
+    for (size_t i = 0; i < ctx->connected_waiters_count; i++)
+    {
+        if (ctx->connected_waiters[i].future != target)
+            continue;
+        memmove(&ctx->connected_waiters[i], &ctx->connected_waiters[i + 1], (--ctx->connected_waiters_count - i) * sizeof(ctx->connected_waiters[0]));
+        AOS_ARGS_T(aos_wifi_client_wait_connected) *args = aos_args_get(target);
+        args->out_err = AOS_WIFI_CLIENT_ERR_CANCELLED;
+        aos_resolve(target);
+        return true;
+    }
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+    {
+        if (ctx->scan_waiters[i].future != target)
+            continue;
+        // Roaming scans have no future, thus only application requests can match
+        _aos_wifi_client_scan_waiter_t waiter = ctx->scan_waiters[i];
+        memmove(&ctx->scan_waiters[i], &ctx->scan_waiters[i + 1], (--ctx->scan_waiters_count - i) * sizeof(ctx->scan_waiters[0]));
+        ESP_LOGI(_tag, "Scan request cancelled (%s)", waiter.active ? "running" : "queued");
+        _aos_wifi_client_scan_waiter_resolve(task, &waiter, AOS_WIFI_CLIENT_ERR_CANCELLED);
+        _aos_wifi_client_scan_orphaned(task);
+        return true;
+    }
+    return false;
+}
+
+static void _aos_wifi_client_notify(_aos_wifi_client_ctx_t *ctx, aos_wifi_client_event_t event, void *args)
+{
+    if (ctx->config.event_handler)
+        ctx->config.event_handler(event, args);
+
+    aos_wifi_client_notification_t notification = {.event = event};
+    if (event == AOS_WIFI_CLIENT_EVENT_RECONNECTED)
+        notification.data.reconnected = *(aos_wifi_client_reconnected_t *)args;
+    else if (event == AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED)
+        notification.data.link_degraded = *(aos_wifi_client_link_degraded_t *)args;
+    for (size_t i = 0; i < ctx->subscribers_count; i++)
+    {
+        _aos_wifi_client_subscriber_t *subscriber = &ctx->subscribers[i];
+        if (!(subscriber->mask & AOS_WIFI_CLIENT_EVENT_MASK(event)))
+            continue;
+        // Never wait, a slow subscriber only loses its own notifications
+        notification.dropped = subscriber->dropped;
+        if (xQueueSend(subscriber->queue, &notification, 0) == pdTRUE)
+            subscriber->dropped = 0;
+        else
+            subscriber->dropped++;
+    }
+}
+
+// TODO: Do we have to deal with out-of-sync notifications in case we connect->disconnect->connect quickly in succession? When should we expect them? IDF is not clear.
+static void _aos_wifi_client_notification_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    AOS_ARGS_T(_aos_wifi_client_notification) *args = aos_args_get(future);
+    _aos_wifi_client_notification_handlers[args->evt](task, &args->data);
+    _aos_wifi_client_pool_release(task, args->slot);
+}
+
+static void _aos_wifi_client_onconnected(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    ESP_LOGI(_tag, "Connected");
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    switch (ctx->state)
+    {
+    case AOS_WIFI_CLIENT_STATE_CONNECTING:
+    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+    {
+        // Reset reconnection counter
+        ctx->reconnection_attempt = 0;
+        // Any leave of ours was reported before this association
+        ctx->leaving = false;
+
+        // Store ip information
+        ctx->ip_info = data->ip_info;
+        ctx->status.ip = ctx->ip_info.ip.addr;
+        ctx->status.netmask = ctx->ip_info.netmask.addr;
+        ctx->status.gw = ctx->ip_info.gw.addr;
+
+        // Remember where we associated to speed up the next connection
+        _aos_wifi_client_hint_store(ctx);
+        ESP_LOGI(_tag, "Connection established (path:%s)", ctx->fastpath ? "fast" : "slow");
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+        if (!ctx->lease_reused)
+        {
+            _resume.lease = ctx->ip_info;
+            _resume.lease_time = time(NULL);
+            _resume.lease_valid = true;
+        }
+#endif
+        if (!ctx->boot_reported)
+        {
+            // esp_timer restarts on every boot, deep sleep wake-ups included
+            uint32_t boot_to_ip_ms = esp_timer_get_time() / 1000;
+            ctx->boot_reported = true;
+            ESP_LOGI(_tag, "First IP since boot (boot_to_ip_ms:%lu lease:%s)", (unsigned long)boot_to_ip_ms, ctx->lease_reused ? "reused" : "dhcp");
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+            ctx->stats.stats.boot_to_ip_ms = boot_to_ip_ms;
+            ctx->stats.stats.boot_lease_reused = ctx->lease_reused;
+#endif
+        }
+
+        // Account for a completed roam, then watch the signal of the new AP
+        if (ctx->roam.in_progress)
+        {
+            unsigned int latency_ms = (esp_timer_get_time() - ctx->roam.started_at) / 1000;
+            ctx->roam.in_progress = false;
+            ctx->roam.stats.successes++;
+            ctx->roam.stats.last_latency_ms = latency_ms;
+            if (latency_ms > ctx->roam.stats.max_latency_ms)
+                ctx->roam.stats.max_latency_ms = latency_ms;
+            ESP_LOGI(_tag, "Roamed (latency_ms:%u)", latency_ms);
+        }
+        ctx->roam.associated_at = esp_timer_get_time();
+        _aos_wifi_client_roam_arm(ctx);
+        _aos_wifi_client_link_start(ctx);
+
+        // If we are reconnecting, raise event
+        if (ctx->state == AOS_WIFI_CLIENT_STATE_RECONNECTING)
+        {
+            aos_wifi_client_reconnected_t reconnected = {.fastpath = ctx->fastpath};
+            _aos_wifi_client_notify(ctx, AOS_WIFI_CLIENT_EVENT_RECONNECTED, &reconnected);
+        }
+
+        // Set state
+        _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_CONNECTED);
+
+        // Resolve connect future and connection waiters if any, last so that the status snapshot is already up to date
+        _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_NONE);
+        _aos_wifi_client_connected_waiters_resolve(task, AOS_WIFI_CLIENT_ERR_NONE);
+
+        break;
+    }
+    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    {
+        // Target state is DISCONNECTED, thus do nothing. It is likely a late notification.
+        break;
+    }
+    }
+}
+
+static void _aos_wifi_client_ondisconnected(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    _aos_wifi_client_stats_reason(ctx, data->disconnected.reason);
+
+    // Our own leave from a link reset, the connection started after it is not affected, nor its lease
+    if (ctx->leaving && data->disconnected.reason == WIFI_REASON_ASSOC_LEAVE)
+    {
+        ctx->leaving = false;
+        if (ctx->state == AOS_WIFI_CLIENT_STATE_CONNECTING)
+        {
+            ESP_LOGD(_tag, "Left previous link");
+            return;
+        }
+    }
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+    // The lease may be what broke the link, later attempts go through DHCP
+    _aos_wifi_client_lease_drop(ctx);
+#endif
+
+    switch (ctx->state)
+    {
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
     case AOS_WIFI_CLIENT_STATE_RECONNECTING:
     case AOS_WIFI_CLIENT_STATE_CONNECTING:
     {
+        // Leaving the old AP is part of roaming, anything else means the reassociation failed
+        if (ctx->roam.in_progress)
+        {
+            if (data->disconnected.reason == WIFI_REASON_ASSOC_LEAVE && !ctx->roam.left)
+            {
+                ctx->roam.left = true;
+                ESP_LOGD(_tag, "Left AP to roam");
+                break;
+            }
+            ESP_LOGW(_tag, "Roaming failed, recovering connection (reason:%u)", data->disconnected.reason);
+            ctx->roam.in_progress = false;
+            ctx->roam.stats.failures++;
+            ctx->hint = ctx->roam.prev_hint;
+        }
+
+        _aos_wifi_client_policy_t policy = _aos_wifi_client_policy_get(data->disconnected.reason);
+        ESP_LOGI(_tag, "Link down (reason:%u policy:%u)", data->disconnected.reason, policy);
+
+        // The AP rejected the given configuration, do not burn the remaining attempts
+        if (ctx->connect_future && policy == AOS_WIFI_CLIENT_POLICY_FAILFAST)
+        {
+            ESP_LOGE(_tag, "Connection rejected, giving up (reason:%u)", data->disconnected.reason);
+            _aos_wifi_client_connect_failed(task, AOS_WIFI_CLIENT_ERR_AUTH);
+            break;
+        }
+
+        // A hinted attempt failed, the AP may have moved. Retry right away with a full scan without counting it as an attempt.
+        if (ctx->fastpath && ctx->state != AOS_WIFI_CLIENT_STATE_CONNECTED)
+        {
+            ESP_LOGI(_tag, "Hinted connection failed, falling back to full scan");
+            ctx->hint.valid = false;
+            esp_err_t err = _aos_wifi_client_hint_set(ctx, false);
+            if (err == ESP_OK)
+                err = _driver->connect();
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(_tag, "Could not start connection (ESP_error:%s)", esp_err_to_name(err));
+                _aos_wifi_client_disconnect(task);
+                _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
+            }
+            break;
+        }
+
         // Are we connecting?
         if (ctx->connect_future)
         {
             // If we tried too many times, just disconnect
-            if (ctx->connection_attempt > ctx->config.connection_attempts)
+            if (ctx->connection_attempt > ctx->connection_budget)
             {
-                ESP_LOGE(_tag, "Maximum connection attempts reached, disconnecting (%u)", ctx->config.connection_attempts);
-                _aos_wifi_client_disconnect(task);
-                ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-                aos_resolve(future);
+                ESP_LOGE(_tag, "Maximum connection attempts reached, disconnecting (%u)", ctx->connection_budget);
+                _aos_wifi_client_connect_failed(task, AOS_WIFI_CLIENT_ERR_FAIL);
                 break;
             }
             // Else, try once more
             ctx->connection_attempt++;
+            _aos_wifi_client_stats_attempt(ctx, false);
             ESP_LOGI(_tag, "Attempting connection (attempt:%u)", ctx->connection_attempt);
-            esp_err_t err = esp_wifi_connect();
+            esp_err_t err = _aos_wifi_client_retry(task, ctx->connection_attempt, policy == AOS_WIFI_CLIENT_POLICY_IMMEDIATE);
             if (err != ESP_OK)
             {
                 ESP_LOGE(_tag, "Could not start connection (ESP_error:%s)", esp_err_to_name(err));
                 _aos_wifi_client_disconnect(task);
-                ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-                aos_resolve(future);
+                _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
                 break;
             }
-            aos_resolve(future);
             break;
         }
         // No, we are recovering
@@ -406,248 +1498,1887 @@ static void _aos_wifi_client_ondisconnected_handler(aos_task_t *task, aos_future
         {
             ESP_LOGE(_tag, "Maximum reconnection attempts reached, disconnecting (%u)", ctx->config.reconnection_attempts);
             _aos_wifi_client_disconnect(task);
-            ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-            ctx->config.event_handler(AOS_WIFI_CLIENT_EVENT_DISCONNECTED, NULL);
-            aos_resolve(future);
+            _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
+            _aos_wifi_client_notify(ctx, AOS_WIFI_CLIENT_EVENT_DISCONNECTED, NULL);
             break;
         }
         ctx->reconnection_attempt++;
+        _aos_wifi_client_stats_attempt(ctx, true);
         ESP_LOGI(_tag, "Attempting reconnection (attempt:%u)", ctx->reconnection_attempt);
-        esp_err_t err = esp_wifi_connect();
+        esp_err_t err = ESP_OK;
+        if (ctx->state == AOS_WIFI_CLIENT_STATE_CONNECTED)
+        {
+            // First attempt after losing the link, try the last known AP first
+            err = _aos_wifi_client_hint_set(ctx, true);
+        }
+        if (err == ESP_OK)
+            err = _aos_wifi_client_retry(task, ctx->reconnection_attempt, policy == AOS_WIFI_CLIENT_POLICY_IMMEDIATE);
         if (err != ESP_OK)
         {
             ESP_LOGE(_tag, "Could not start connection (ESP_error:%s)", esp_err_to_name(err));
             _aos_wifi_client_disconnect(task);
-            ctx->state = AOS_WIFI_CLIENT_STATE_DISCONNECTED;
-            aos_resolve(future);
+            _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
             break;
         }
-        ctx->state = AOS_WIFI_CLIENT_STATE_RECONNECTING;
-        ctx->config.event_handler(AOS_WIFI_CLIENT_EVENT_RECONNECTING, NULL);
+        _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_RECONNECTING);
+        _aos_wifi_client_notify(ctx, AOS_WIFI_CLIENT_EVENT_RECONNECTING, NULL);
         ESP_LOGI(_tag, "Connection recovered");
-        aos_resolve(future);
         break;
     }
     case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
     {
         // Target state is DISCONNECTED, thus do nothing. It is likely a late notification.
-        aos_resolve(future);
         break;
     }
     }
 }
 
-AOS_DEFINE(aos_wifi_client_scan, aos_wifi_client_scan_result_t *, size_t, size_t, uint32_t)
-aos_future_t *aos_wifi_client_scan(aos_future_t *future)
-{
-    return aos_task_send(_task, AOS_WIFI_CLIENT_EVT_SCAN, future);
-}
-static void _aos_wifi_client_scan_handler(aos_task_t *task, aos_future_t *future)
+static void _aos_wifi_client_onretry(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
-    AOS_ARGS_T(aos_wifi_client_scan) *args = aos_args_get(future);
+
+    // Ignore timers cancelled or rescheduled after they fired
+    if (!ctx->retry_pending || data->retry_seq != ctx->retry_seq)
+    {
+        ESP_LOGD(_tag, "Stale retry, ignoring (seq:%u current:%u)", data->retry_seq, ctx->retry_seq);
+        return;
+    }
+    ctx->retry_pending = false;
 
     switch (ctx->state)
     {
-    case AOS_WIFI_CLIENT_STATE_CONNECTED:
-    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
     case AOS_WIFI_CLIENT_STATE_CONNECTING:
     case AOS_WIFI_CLIENT_STATE_RECONNECTING:
     {
-        // Resolve unfinished scan if any
-        _aos_wifi_client_stopcurrentscan(task);
-
-        // Start scan
-        esp_err_t err = esp_wifi_scan_start(NULL, false);
+        esp_err_t err = _driver->connect();
         if (err != ESP_OK)
         {
-            // We cannot scan while connecting according to documentation
-            ESP_LOGE(_tag, "Could not start scan (ESP_error:%s)", esp_err_to_name(err));
-            args->out_err = 1;
-            aos_resolve(future);
-            break;
+            ESP_LOGE(_tag, "Could not start connection (ESP_error:%s)", esp_err_to_name(err));
+            _aos_wifi_client_disconnect(task);
+            _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_DISCONNECTED);
         }
-        ESP_LOGI(_tag, "Scanning");
-        ctx->scan_future = future;
+        break;
+    }
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    {
+        // Nothing to retry anymore
         break;
     }
     }
 }
 
-AOS_DECLARE(_aos_wifi_client_onscandone)
-AOS_DEFINE(_aos_wifi_client_onscandone)
-static void _aos_wifi_client_onscandone_handler(aos_task_t *task, aos_future_t *future)
+AOS_DEFINE(aos_wifi_client_network_add, const char *, const char *, uint8_t, uint32_t)
+aos_future_t *aos_wifi_client_network_add(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_NETWORK_ADD, future);
+}
+static void _aos_wifi_client_network_add_handler(aos_task_t *task, aos_future_t *future)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    AOS_ARGS_T(aos_wifi_client_network_add) *args = aos_args_get(future);
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
-    switch (ctx->state)
+    // Input checking
+    const char *password = args->in_password ? args->in_password : "";
+    if (!args->in_ssid || !args->in_ssid[0] ||
+        strlen(args->in_ssid) >= sizeof(ctx->networks[0].ssid) / sizeof(char) ||
+        strlen(password) >= sizeof(ctx->networks[0].password) / sizeof(char))
     {
-    case AOS_WIFI_CLIENT_STATE_CONNECTED:
-    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
-    case AOS_WIFI_CLIENT_STATE_CONNECTING:
-    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
+        ESP_LOGW(_tag, "Invalid SSID or password too long");
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+        aos_resolve(future);
+        return;
+    }
+
+    // Update in place if known, otherwise take a new entry
+    int i = _aos_wifi_client_network_find(ctx, args->in_ssid);
+    if (i < 0)
     {
-        if (!ctx->scan_future)
+        if (ctx->networks_count >= CONFIG_AOS_WIFI_CLIENT_NETWORKS)
         {
-            // We need to call this to free memory in the driver according to esp_wifi_scan_start docs
-            uint16_t n = 0;
-            wifi_ap_record_t m = {};
-            esp_err_t err = esp_wifi_scan_get_ap_records(&n, &m);
-            ESP_LOGW(_tag, "Could not find scan future, cleaning up (esp_wifi_scan_get_ap_records:%s)", esp_err_to_name(err));
+            ESP_LOGW(_tag, "Known networks store full (max:%u)", CONFIG_AOS_WIFI_CLIENT_NETWORKS);
+            args->out_err = AOS_WIFI_CLIENT_ERR_BUSY;
             aos_resolve(future);
-            break;
-        }
-
-        AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(ctx->scan_future);
-        wifi_ap_record_t *results = NULL;
-
-        // Allocate temporary structure for results
-        uint16_t results_cnt = scan_args->in_results_size;
-        results = calloc(results_cnt, sizeof(wifi_ap_record_t));
-        if (!results)
-        {
-            ESP_LOGE(_tag, "Allocation error");
-            scan_args->out_err = 1; // TODO: Ensure correct error
-            goto _aos_wifi_client_onscandone_handler_end;
+            return;
         }
+        i = ctx->networks_count++;
+    }
+    _aos_wifi_client_network_t *network = &ctx->networks[i];
+    strcpy(network->ssid, args->in_ssid);
+    strcpy(network->password, password);
+    network->priority = args->in_priority;
+    ESP_LOGI(_tag, "Known network stored (ssid:%s priority:%u)", network->ssid, network->priority);
+    args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+    aos_resolve(future);
+}
 
-        // Get results
-        esp_err_t err = esp_wifi_scan_get_ap_records(&results_cnt, results);
-        if (err != ESP_OK)
-        {
-            ESP_LOGE(_tag, "Could not get AP records (esp_wifi_scan_get_ap_records:%s)", esp_err_to_name(err));
-            scan_args->out_err = 2; // TODO: Ensure correct error
-            goto _aos_wifi_client_onscandone_handler_end;
-        }
-        for (size_t i = 0; i < results_cnt; i++)
-        {
-            memset(scan_args->in_results[i].ssid, 0, sizeof(scan_args->in_results[i].ssid));
-            strncpy(scan_args->in_results[i].ssid, (char *)results[i].ssid, sizeof(results[i].ssid) / sizeof(char));
-            scan_args->in_results[i].open = results[i].authmode == WIFI_AUTH_OPEN ? 1 : 0; // TODO: Likely we want something more elaborate here
-            scan_args->in_results[i].strength = ((float)results[i].rssi / INT8_MAX) + 1;   // TODO: Assess this is the correct scale, RSSI scale depends on manufacturer and no docs could be found in IDF
-        }
-        scan_args->out_results_count = results_cnt;
-        scan_args->out_err = 0;
-        ESP_LOGI(_tag, "Scan done");
+AOS_DEFINE(aos_wifi_client_network_remove, const char *, uint32_t)
+aos_future_t *aos_wifi_client_network_remove(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_NETWORK_REMOVE, future);
+}
+static void _aos_wifi_client_network_remove_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    AOS_ARGS_T(aos_wifi_client_network_remove) *args = aos_args_get(future);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
 
-    _aos_wifi_client_onscandone_handler_end:
-        free(results);
+    int i = args->in_ssid ? _aos_wifi_client_network_find(ctx, args->in_ssid) : -1;
+    if (i < 0)
+    {
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
         aos_resolve(future);
-        aos_resolve(ctx->scan_future);
-        ctx->scan_future = NULL;
-        break;
-    }
+        return;
     }
+
+    // Keep the store packed. Candidates refer to networks by index, thus drop any ranking in progress.
+    ctx->networks[i] = ctx->networks[--ctx->networks_count];
+    ctx->candidates_count = 0;
+    ESP_LOGI(_tag, "Known network removed (ssid:%s)", args->in_ssid);
+    args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+    aos_resolve(future);
 }
 
-static void _aos_wifi_client_disconnect(aos_task_t *task)
+static int _aos_wifi_client_network_find(_aos_wifi_client_ctx_t *ctx, const char *ssid)
+{
+    for (size_t i = 0; i < ctx->networks_count; i++)
+        if (!strncmp(ctx->networks[i].ssid, ssid, sizeof(ctx->networks[i].ssid) / sizeof(char)))
+            return i;
+    return -1;
+}
+
+AOS_DEFINE(aos_wifi_client_connect_best, unsigned int, uint32_t, bool)
+aos_future_t *aos_wifi_client_connect_best(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_CONNECT_BEST, future);
+}
+static void _aos_wifi_client_connect_best_handler(aos_task_t *task, aos_future_t *future)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
-    esp_wifi_disconnect();
-    if (ctx->connect_future)
+
+    if (!ctx->networks_count)
     {
-        AOS_ARGS_T(aos_wifi_client_connect) *args = aos_args_get(ctx->connect_future);
-        args->out_err = 1;
-        aos_resolve(ctx->connect_future);
-        ctx->connect_future = NULL;
+        ESP_LOGW(_tag, "No known networks");
+        AOS_ARGS_T(aos_wifi_client_connect_best) *args = aos_args_get(future);
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+        aos_resolve(future);
+        return;
     }
+
+    // Rank what the scan finds, the connection starts once the scan is done
+    if (ctx->best_future && ctx->best_future != future)
+        ESP_LOGI(_tag, "Superseding pending best network selection");
+    ctx->best_future = future;
+    ctx->candidates_count = 0;
+    _aos_wifi_client_scan_start(task, future, AOS_WIFI_CLIENT_SCAN_CANDIDATES);
 }
 
-static void _aos_wifi_client_stopcurrentscan(aos_task_t *task)
+static bool _aos_wifi_client_candidate_add(const aos_wifi_client_scan_result_t *result, void *arg)
+{
+    _aos_wifi_client_ctx_t *ctx = arg;
+    int network = _aos_wifi_client_network_find(ctx, result->ssid);
+    if (network < 0)
+        return true;
+
+    // Several APs may serve the same network, keep the strongest
+    for (size_t i = 0; i < ctx->candidates_count; i++)
+    {
+        if (ctx->candidates[i].network == network)
+        {
+            if (result->strength > ctx->candidates[i].strength)
+                ctx->candidates[i].strength = result->strength;
+            return true;
+        }
+    }
+    ctx->candidates[ctx->candidates_count++] = (_aos_wifi_client_candidate_t){.network = network, .strength = result->strength};
+    return true;
+}
+
+static void _aos_wifi_client_candidates_ready(aos_task_t *task, aos_future_t *future, int64_t deadline)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
     _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
-    if (ctx->scan_future)
+    AOS_ARGS_T(aos_wifi_client_connect_best) *args = aos_args_get(future);
+
+    if (ctx->best_future != future)
     {
-        esp_err_t err0 = esp_wifi_scan_stop();
-        // Cleanup incomplete scan results
-        uint16_t n = 0;
-        wifi_ap_record_t m = {};
-        esp_err_t err1 = esp_wifi_scan_get_ap_records(&n, &m);
-        ESP_LOGD(_tag, "Stopped scan (esp_wifi_scan_stop:%s esp_wifi_scan_get_ap_records:%s)", esp_err_to_name(err0), esp_err_to_name(err1));
-        AOS_ARGS_T(aos_wifi_client_scan) *scan_future_args = aos_args_get(ctx->scan_future);
-        scan_future_args->out_err = 1;
-        aos_resolve(ctx->scan_future);
-        ctx->scan_future = NULL;
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+        aos_resolve(future);
+        return;
+    }
+    ctx->best_future = NULL;
+    if (!ctx->candidates_count)
+    {
+        ESP_LOGW(_tag, "No known network in range");
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+        aos_resolve(future);
+        return;
     }
+
+    // Rank by priority, then by signal strength (insertion sort, the list is tiny)
+    for (size_t i = 1; i < ctx->candidates_count; i++)
+    {
+        _aos_wifi_client_candidate_t candidate = ctx->candidates[i];
+        uint8_t priority = ctx->networks[candidate.network].priority;
+        size_t j = i;
+        for (; j > 0; j--)
+        {
+            const _aos_wifi_client_candidate_t *prev = &ctx->candidates[j - 1];
+            uint8_t prev_priority = ctx->networks[prev->network].priority;
+            if (prev_priority > priority || (prev_priority == priority && prev->strength >= candidate.strength))
+                break;
+            ctx->candidates[j] = *prev;
+        }
+        ctx->candidates[j] = candidate;
+    }
+
+    // Supersede any pending request, including an intent not applied yet, and connect as a regular request would.
+    // Nothing is done if we are already on the best network.
+    const _aos_wifi_client_network_t *best = &ctx->networks[ctx->candidates[0].network];
+    ESP_LOGI(_tag, "Connecting to best network (ssid:%s candidates:%u)", best->ssid, (unsigned int)ctx->candidates_count);
+    _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+    ctx->connect_future = future;
+    ctx->connect_deadline = deadline;
+    ctx->connect_kind = AOS_WIFI_CLIENT_CONNECT_BEST;
+    ctx->candidate = 0;
+    if (ctx->connect_deadline)
+        _aos_wifi_client_deadline_arm(ctx);
+    ctx->intent.pending = true;
+    ctx->intent.connect = true;
+    strcpy(ctx->intent.ssid, best->ssid);
+    strcpy(ctx->intent.password, best->password);
+    _aos_wifi_client_intent_apply(task);
 }
 
-static void _aos_wifi_client_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+static bool _aos_wifi_client_candidate_next(aos_task_t *task)
 {
     ESP_LOGD(_tag, "%s", __FUNCTION__);
-    ESP_LOGD(_tag, "event_base:%s event_id:%d", event_base, event_id);
-    if (event_base == WIFI_EVENT)
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    bool list = ctx->connect_kind == AOS_WIFI_CLIENT_CONNECT_LIST;
+    while (++ctx->candidate < (list ? ctx->fallbacks_count : ctx->candidates_count))
     {
-        if (event_id == WIFI_EVENT_STA_DISCONNECTED)
+        const char *ssid, *password;
+        if (list)
         {
-            wifi_event_sta_disconnected_t *event = event_data; // FIXME: Is this freed on handler exit? Should we duplicate it?
-            aos_future_t *future = AOS_FORGETTABLE_ALLOC_T(_aos_wifi_client_ondisconnected)(event);
-            if (!future)
-            {
-                ESP_LOGE(_tag, "Allocation error");
-                return;
-            }
-            aos_task_send(_task, AOS_WIFI_CLIENT_EVT_DISCONNECTED, future);
+            ssid = ctx->fallbacks[ctx->candidate].ssid;
+            password = ctx->fallbacks[ctx->candidate].password;
         }
-        else if (event_id == WIFI_EVENT_SCAN_DONE)
+        else
         {
-            aos_future_t *future = AOS_FORGETTABLE_ALLOC_T(_aos_wifi_client_onscandone)();
-            if (!future)
-            {
-                ESP_LOGE(_tag, "Allocation error");
-                return;
-            }
-            aos_task_send(_task, AOS_WIFI_CLIENT_EVT_SCANDONE, future);
+            const _aos_wifi_client_network_t *network = &ctx->networks[ctx->candidates[ctx->candidate].network];
+            ssid = network->ssid;
+            password = network->password;
         }
-    }
-    else if (event_base == IP_EVENT)
-    {
-        if (event_id == IP_EVENT_STA_GOT_IP)
+        // Keep the intent in sync, a later identical request then finds the link already up
+        ssid = strcpy(ctx->intent.ssid, ssid);
+        password = strcpy(ctx->intent.password, password);
+        ESP_LOGI(_tag, "Falling back to next network (ssid:%s candidate:%u)", ssid, (unsigned int)ctx->candidate);
+        if (_aos_wifi_client_connect_start(task, ssid, password) == ESP_OK)
         {
-            aos_future_t *future = AOS_FORGETTABLE_ALLOC_T(_aos_wifi_client_onconnected)(&((ip_event_got_ip_t *)event_data)->ip_info); // FIXME: Is this freed on handler exit? Should we duplicate it?
-            if (!future)
-            {
-                ESP_LOGE(_tag, "Allocation error");
-                return;
-            }
-            aos_task_send(_task, AOS_WIFI_CLIENT_EVT_CONNECTED, future);
+            _aos_wifi_client_state_set(ctx, AOS_WIFI_CLIENT_STATE_CONNECTING);
+            return true;
         }
     }
+    return false;
 }
 
-/**
- * WiFi driver disconnection reason reference:
- *  WIFI_REASON_UNSPECIFIED              = 1,
- *  WIFI_REASON_AUTH_EXPIRE              = 2,
- *  WIFI_REASON_AUTH_LEAVE               = 3,
- *  WIFI_REASON_ASSOC_EXPIRE             = 4,
- *  WIFI_REASON_ASSOC_TOOMANY            = 5,
- *  WIFI_REASON_NOT_AUTHED               = 6,
- *  WIFI_REASON_NOT_ASSOCED              = 7,
- *  WIFI_REASON_ASSOC_LEAVE              = 8,
- *  WIFI_REASON_ASSOC_NOT_AUTHED         = 9,
- *  WIFI_REASON_DISASSOC_PWRCAP_BAD      = 10,
- *  WIFI_REASON_DISASSOC_SUPCHAN_BAD     = 11,
- *  WIFI_REASON_IE_INVALID               = 13,
- *  WIFI_REASON_MIC_FAILURE              = 14,
- *  WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT   = 15,
- *  WIFI_REASON_GROUP_KEY_UPDATE_TIMEOUT = 16,
- *  WIFI_REASON_IE_IN_4WAY_DIFFERS       = 17,
- *  WIFI_REASON_GROUP_CIPHER_INVALID     = 18,
- *  WIFI_REASON_PAIRWISE_CIPHER_INVALID  = 19,
- *  WIFI_REASON_AKMP_INVALID             = 20,
- *  WIFI_REASON_UNSUPP_RSN_IE_VERSION    = 21,
- *  WIFI_REASON_INVALID_RSN_IE_CAP       = 22,
- *  WIFI_REASON_802_1X_AUTH_FAILED       = 23,
- *  WIFI_REASON_CIPHER_SUITE_REJECTED    = 24,
- *  WIFI_REASON_INVALID_PMKID            = 53,
- *  WIFI_REASON_BEACON_TIMEOUT           = 200,
- *  WIFI_REASON_NO_AP_FOUND              = 201,
- *  WIFI_REASON_AUTH_FAIL                = 202,
- *  WIFI_REASON_ASSOC_FAIL               = 203,
- *  WIFI_REASON_HANDSHAKE_TIMEOUT        = 204,
- *  WIFI_REASON_CONNECTION_FAIL          = 205,
+AOS_DEFINE(aos_wifi_client_connect_list, const aos_wifi_client_credentials_t *, size_t, unsigned int, uint32_t, size_t, bool)
+aos_future_t *aos_wifi_client_connect_list(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_CONNECT_LIST, future);
+}
+static void _aos_wifi_client_connect_list_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    uint32_t queued = _aos_wifi_client_queue_pop(task);
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_lane_drain(task);
+#endif
+    AOS_ARGS_T(aos_wifi_client_connect_list) *args = aos_args_get(future);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    // Input checking
+    args->out_index = 0;
+    args->out_fastpath = false;
+    if (!args->in_list || !args->in_count || args->in_count > CONFIG_AOS_WIFI_CLIENT_FALLBACKS)
+    {
+        ESP_LOGW(_tag, "Invalid network list (count:%u max:%u)", (unsigned int)args->in_count, CONFIG_AOS_WIFI_CLIENT_FALLBACKS);
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+        aos_resolve(future);
+        return;
+    }
+    for (size_t i = 0; i < args->in_count; i++)
+    {
+        const aos_wifi_client_credentials_t *entry = &args->in_list[i];
+        if (!entry->ssid || !entry->ssid[0] ||
+            strlen(entry->ssid) >= sizeof(ctx->fallbacks[0].ssid) / sizeof(char) ||
+            (entry->password && strlen(entry->password) >= sizeof(ctx->fallbacks[0].password) / sizeof(char)))
+        {
+            ESP_LOGW(_tag, "Invalid SSID or password too long (index:%u)", (unsigned int)i);
+            args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+            args->out_index = i;
+            aos_resolve(future);
+            return;
+        }
+    }
+
+    // Supersede any pending request, then walk the list from the first entry as a regular connection would
+    _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+    ctx->best_future = NULL;
+    for (size_t i = 0; i < args->in_count; i++)
+    {
+        _aos_wifi_client_fallback_t *fallback = &ctx->fallbacks[i];
+        strcpy(fallback->ssid, args->in_list[i].ssid);
+        strcpy(fallback->password, args->in_list[i].password ? args->in_list[i].password : "");
+        fallback->attempts = args->in_list[i].attempts;
+    }
+    ctx->fallbacks_count = args->in_count;
+    ctx->candidate = 0;
+    ctx->connect_future = future;
+    ctx->connect_deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+    ctx->connect_kind = AOS_WIFI_CLIENT_CONNECT_LIST;
+    if (ctx->connect_deadline)
+        _aos_wifi_client_deadline_arm(ctx);
+    ctx->intent.pending = true;
+    ctx->intent.connect = true;
+    strcpy(ctx->intent.ssid, ctx->fallbacks[0].ssid);
+    strcpy(ctx->intent.password, ctx->fallbacks[0].password);
+    if (queued)
+        ESP_LOGD(_tag, "Deferring connection (queued:%u)", queued);
+    else
+        _aos_wifi_client_intent_apply(task);
+}
+
+static void _aos_wifi_client_onroam(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    const aos_wifi_client_roaming_t *roaming = &ctx->config.roaming;
+
+    switch (ctx->state)
+    {
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+    {
+        if (!roaming->rssi_threshold || ctx->roam.in_progress || ctx->roam.scanning)
+            break;
+
+        // Stay on a new AP for a while, otherwise devices between two APs would bounce
+        unsigned int elapsed_ms = (esp_timer_get_time() - ctx->roam.associated_at) / 1000;
+        if (elapsed_ms < roaming->min_dwell_ms)
+        {
+            _aos_wifi_client_roam_schedule(ctx, roaming->min_dwell_ms - elapsed_ms);
+            break;
+        }
+
+        // The signal may have recovered since the threshold triggered
+        wifi_ap_record_t ap = {};
+        esp_err_t err = _driver->sta_get_ap_info(&ap);
+        if (err != ESP_OK)
+            break;
+        ctx->status.rssi = ap.rssi;
+        _aos_wifi_client_status_publish(ctx);
+        if (ap.rssi > roaming->rssi_threshold)
+        {
+            _aos_wifi_client_roam_arm(ctx);
+            break;
+        }
+
+        ESP_LOGI(_tag, "Weak signal, looking for a better AP (rssi:%d)", ap.rssi);
+        _aos_wifi_client_roam_scan(task, &ap);
+        break;
+    }
+    case AOS_WIFI_CLIENT_STATE_CONNECTING:
+    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
+    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    {
+        // Regular (re)connection takes over
+        break;
+    }
+    }
+}
+
+// Look for other APs of the same network than the current one
+static void _aos_wifi_client_roam_scan(aos_task_t *task, const wifi_ap_record_t *ap)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    memcpy(ctx->roam.bssid, ap->bssid, sizeof(ctx->roam.bssid));
+    ctx->roam.best_valid = false;
+    ctx->roam.scanning = true;
+    ctx->roam.stats.scans++;
+    _aos_wifi_client_scan_start(task, NULL, AOS_WIFI_CLIENT_SCAN_ROAM);
+}
+
+static bool _aos_wifi_client_roam_candidate(const aos_wifi_client_scan_result_t *result, void *arg)
+{
+    _aos_wifi_client_ctx_t *ctx = arg;
+    if (!memcmp(result->bssid, ctx->roam.bssid, sizeof(ctx->roam.bssid)))
+        return true;
+    if (!ctx->roam.best_valid || result->rssi > ctx->roam.best.rssi)
+    {
+        ctx->roam.best = *result;
+        ctx->roam.best_valid = true;
+    }
+    return true;
+}
+
+static void _aos_wifi_client_roam_evaluate(aos_task_t *task, uint32_t err)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    const aos_wifi_client_roaming_t *roaming = &ctx->config.roaming;
+    ctx->roam.scanning = false;
+    if (ctx->state != AOS_WIFI_CLIENT_STATE_CONNECTED || ctx->roam.in_progress)
+        return;
+
+    // Roam only if clearly better, otherwise look again later
+    wifi_ap_record_t ap = {};
+    if (err != AOS_WIFI_CLIENT_ERR_NONE ||
+        !ctx->roam.best_valid ||
+        _driver->sta_get_ap_info(&ap) != ESP_OK ||
+        ctx->roam.best.rssi < ap.rssi + roaming->hysteresis_db)
+    {
+        ESP_LOGI(_tag, "No better AP (err:%u rssi:%d best:%d)", err, ap.rssi, ctx->roam.best_valid ? ctx->roam.best.rssi : 0);
+        _aos_wifi_client_roam_schedule(ctx, roaming->min_dwell_ms);
+        return;
+    }
+
+    // Reassociate through the hint, keeping the previous one should the new AP fail
+    ESP_LOGI(_tag, "Roaming (rssi:%d target_rssi:%d channel:%u)", ap.rssi, ctx->roam.best.rssi, ctx->roam.best.channel);
+    ctx->roam.prev_hint = ctx->hint;
+    memcpy(ctx->hint.bssid, ctx->roam.best.bssid, sizeof(ctx->hint.bssid));
+    ctx->hint.channel = ctx->roam.best.channel;
+    ctx->roam.started_at = esp_timer_get_time();
+    ctx->roam.in_progress = true;
+    ctx->roam.left = false;
+    ctx->roam.stats.attempts++;
+    _driver->disconnect();
+    esp_err_t esp_err = _aos_wifi_client_hint_set(ctx, true);
+    if (esp_err == ESP_OK)
+        esp_err = _driver->connect();
+    if (esp_err != ESP_OK)
+    {
+        // We already left, the disconnection notification starts the regular recovery
+        ESP_LOGE(_tag, "Could not start roaming (ESP_error:%s)", esp_err_to_name(esp_err));
+        ctx->roam.in_progress = false;
+        ctx->roam.stats.failures++;
+        ctx->hint = ctx->roam.prev_hint;
+    }
+}
+
+static void _aos_wifi_client_roam_arm(_aos_wifi_client_ctx_t *ctx)
+{
+    if (!ctx->config.roaming.rssi_threshold)
+        return;
+    // The driver reports a low RSSI only once per threshold set
+    esp_err_t err = _driver->set_rssi_threshold(ctx->config.roaming.rssi_threshold);
+    if (err != ESP_OK)
+        ESP_LOGW(_tag, "Could not set RSSI threshold (ESP_error:%s)", esp_err_to_name(err));
+}
+
+static void _aos_wifi_client_roam_schedule(_aos_wifi_client_ctx_t *ctx, unsigned int delay_ms)
+{
+    TickType_t delay = pdMS_TO_TICKS(delay_ms);
+    if (xTimerChangePeriod(ctx->roam.timer, delay ? delay : 1, 0) != pdPASS)
+        ESP_LOGW(_tag, "Could not schedule roaming check");
+}
+
+static void _aos_wifi_client_roam_timer_cb(TimerHandle_t timer)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_notification_data_t data = {};
+    _aos_wifi_client_timer_post(AOS_WIFI_CLIENT_EVT_ROAM, &data);
+}
+
+static void _aos_wifi_client_onlinksample(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    const aos_wifi_client_link_monitor_t *monitor = &ctx->config.link_monitor;
+
+    switch (ctx->state)
+    {
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+    {
+        // Samples taken while reassociating would describe neither AP
+        if (ctx->roam.in_progress)
+            break;
+        wifi_ap_record_t ap = {};
+        esp_err_t err = _driver->sta_get_ap_info(&ap);
+        if (err != ESP_OK)
+        {
+            ESP_LOGD(_tag, "Could not sample RSSI (ESP_error:%s)", esp_err_to_name(err));
+            break;
+        }
+
+        // The trend is smoothed alike, as the derivative of the average would follow every sample otherwise
+        float alpha = monitor->alpha > 0 && monitor->alpha <= 1 ? monitor->alpha : _AOS_WIFI_CLIENT_LINK_ALPHA;
+        _aos_wifi_client_link_t *link = &ctx->link;
+        int64_t now = esp_timer_get_time();
+        if (!link->samples++)
+        {
+            link->avg = ap.rssi;
+            link->trend = 0;
+        }
+        else if (now > link->sampled_at)
+        {
+            float prev = link->avg;
+            link->avg += alpha * (ap.rssi - link->avg);
+            link->trend += alpha * ((link->avg - prev) * 1000000 / (now - link->sampled_at) - link->trend);
+        }
+        link->sampled_at = now;
+        ctx->status.rssi = ap.rssi;
+        ctx->status.rssi_avg = link->avg;
+        ctx->status.rssi_trend = link->trend;
+        _aos_wifi_client_status_publish(ctx);
+
+        // Report on the way down only, quality must recover before the next report
+        bool degraded = (monitor->rssi_threshold && link->avg < monitor->rssi_threshold) ||
+                        (monitor->trend_threshold && link->trend < monitor->trend_threshold);
+        if (degraded == link->degraded)
+            break;
+        link->degraded = degraded;
+        if (!degraded)
+        {
+            ESP_LOGI(_tag, "Link recovered (rssi_avg:%.1f trend:%.2f)", link->avg, link->trend);
+            break;
+        }
+        ESP_LOGW(_tag, "Link degraded (rssi:%d rssi_avg:%.1f trend:%.2f)", ap.rssi, link->avg, link->trend);
+        aos_wifi_client_link_degraded_t degraded_data = {.rssi = ap.rssi, .rssi_avg = link->avg, .rssi_trend = link->trend};
+        _aos_wifi_client_notify(ctx, AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED, &degraded_data);
+
+        // Proactive reassociation, under the same dwell rule as roaming
+        if (monitor->reassociate && !ctx->roam.scanning &&
+            esp_timer_get_time() - ctx->roam.associated_at >= (int64_t)ctx->config.roaming.min_dwell_ms * 1000)
+            _aos_wifi_client_roam_scan(task, &ap);
+        break;
+    }
+    case AOS_WIFI_CLIENT_STATE_CONNECTING:
+    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
+    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    {
+        // Restarted on the next association
+        xTimerStop(ctx->link.timer, 0);
+        break;
+    }
+    }
+}
+
+static void _aos_wifi_client_link_start(_aos_wifi_client_ctx_t *ctx)
+{
+    if (!ctx->config.link_monitor.period_ms)
+        return;
+    // A new AP starts a new average
+    ctx->link.samples = 0;
+    ctx->link.degraded = false;
+    TickType_t period = pdMS_TO_TICKS(ctx->config.link_monitor.period_ms);
+    if (xTimerChangePeriod(ctx->link.timer, period ? period : 1, 0) != pdPASS)
+        ESP_LOGW(_tag, "Could not start link monitor");
+}
+
+static void _aos_wifi_client_link_timer_cb(TimerHandle_t timer)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_notification_data_t data = {};
+    _aos_wifi_client_timer_post(AOS_WIFI_CLIENT_EVT_LINK_SAMPLE, &data);
+}
+
+AOS_DEFINE(aos_wifi_client_roam_stats_get, aos_wifi_client_roam_stats_t)
+aos_future_t *aos_wifi_client_roam_stats_get(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_ROAM_STATS_GET, future);
+}
+static void _aos_wifi_client_roam_stats_get_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    AOS_ARGS_T(aos_wifi_client_roam_stats_get) *args = aos_args_get(future);
+    args->out_stats = ctx->roam.stats;
+    aos_resolve(future);
+}
+
+AOS_DEFINE(aos_wifi_client_set_power_mode, aos_wifi_client_power_mode_t, uint16_t, unsigned int)
+aos_future_t *aos_wifi_client_set_power_mode(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_SET_POWER_MODE, future);
+}
+static void _aos_wifi_client_set_power_mode_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    AOS_ARGS_T(aos_wifi_client_set_power_mode) *args = aos_args_get(future);
+
+    if (args->in_mode > AOS_WIFI_CLIENT_POWER_SAVING)
+    {
+        ESP_LOGW(_tag, "Invalid power mode (mode:%u)", args->in_mode);
+        args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+        aos_resolve(future);
+        return;
+    }
+
+    // Power save can be changed while associated, the listen interval is only negotiated on the next association
+    esp_err_t err = _driver->set_ps(_aos_wifi_client_ps_get(args->in_mode));
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(_tag, "Could not set power save mode (ESP_error:%s)", esp_err_to_name(err));
+        args->out_err = AOS_WIFI_CLIENT_ERR_DRIVER;
+        aos_resolve(future);
+        return;
+    }
+    ctx->config.power.mode = args->in_mode;
+    ctx->config.power.listen_interval = args->in_listen_interval;
+    ESP_LOGI(_tag, "Power mode set (mode:%u listen_interval:%u)", args->in_mode, args->in_listen_interval);
+    args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+    aos_resolve(future);
+}
+
+void aos_wifi_client_power_tradeoff_get(const aos_wifi_client_power_t *power, aos_wifi_client_power_tradeoff_t *tradeoff)
+{
+    const unsigned int beacon_ms = 103; // 102.4ms rounded up
+    switch (power->mode)
+    {
+    case AOS_WIFI_CLIENT_POWER_BALANCED:
+        tradeoff->max_latency_ms = beacon_ms;
+        tradeoff->throughput_pct = 70;
+        break;
+    case AOS_WIFI_CLIENT_POWER_SAVING:
+        tradeoff->max_latency_ms = beacon_ms * (power->listen_interval ? power->listen_interval : 3);
+        tradeoff->throughput_pct = 40;
+        break;
+    case AOS_WIFI_CLIENT_POWER_PERFORMANCE:
+    default:
+        tradeoff->max_latency_ms = 0;
+        tradeoff->throughput_pct = 100;
+        break;
+    }
+}
+
+AOS_DEFINE(aos_wifi_client_scan, aos_wifi_client_scan_result_t *, size_t, const aos_wifi_client_scan_spec_t *, unsigned int, size_t, uint32_t)
+aos_future_t *aos_wifi_client_scan(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_SCAN, future);
+}
+static void _aos_wifi_client_scan_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_scan_start(task, future, AOS_WIFI_CLIENT_SCAN_RESULTS);
+}
+
+AOS_DEFINE(aos_wifi_client_scan_stream, aos_wifi_client_scan_cb_t, void *, const aos_wifi_client_scan_spec_t *, unsigned int, size_t, uint32_t)
+aos_future_t *aos_wifi_client_scan_stream(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_SCAN_STREAM, future);
+}
+static void _aos_wifi_client_scan_stream_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_scan_start(task, future, AOS_WIFI_CLIENT_SCAN_STREAM);
+}
+
+static void _aos_wifi_client_scan_start(aos_task_t *task, aos_future_t *future, _aos_wifi_client_scan_kind_t kind)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    // Prepare delivery
+    _aos_wifi_client_scan_waiter_t waiter = {.future = future, .kind = kind};
+    switch (kind)
+    {
+    case AOS_WIFI_CLIENT_SCAN_RESULTS:
+    {
+        AOS_ARGS_T(aos_wifi_client_scan) *args = aos_args_get(future);
+        waiter.results = args->in_results;
+        waiter.results_size = args->in_results_size;
+        waiter.deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+        _aos_wifi_client_scan_spec_set(&waiter.spec, args->in_spec);
+        break;
+    }
+    case AOS_WIFI_CLIENT_SCAN_STREAM:
+    {
+        AOS_ARGS_T(aos_wifi_client_scan_stream) *args = aos_args_get(future);
+        waiter.callback = args->in_callback;
+        waiter.arg = args->in_arg;
+        waiter.deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+        _aos_wifi_client_scan_spec_set(&waiter.spec, args->in_spec);
+        break;
+    }
+    case AOS_WIFI_CLIENT_SCAN_CANDIDATES:
+    {
+        AOS_ARGS_T(aos_wifi_client_connect_best) *args = aos_args_get(future);
+        waiter.callback = _aos_wifi_client_candidate_add;
+        waiter.arg = ctx;
+        waiter.deadline = _aos_wifi_client_deadline(args->in_timeout_ms);
+        _aos_wifi_client_scan_spec_set(&waiter.spec, NULL);
+        break;
+    }
+    case AOS_WIFI_CLIENT_SCAN_ROAM:
+    {
+        // Only the APs of the current network matter
+        char ssid[sizeof(ctx->hint.ssid) + 1] = {};
+        memcpy(ssid, ctx->hint.ssid, sizeof(ctx->hint.ssid));
+        aos_wifi_client_scan_spec_t spec = {.ssid = ssid};
+        waiter.callback = _aos_wifi_client_roam_candidate;
+        waiter.arg = ctx;
+        _aos_wifi_client_scan_spec_set(&waiter.spec, &spec);
+        break;
+    }
+    }
+
+    switch (ctx->state)
+    {
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    case AOS_WIFI_CLIENT_STATE_CONNECTING:
+    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
+    {
+        // Answer from cache if fresh enough
+        if (ctx->scan_cache.valid && _aos_wifi_client_scan_spec_isdefault(&waiter.spec) &&
+            esp_timer_get_time() - ctx->scan_cache.timestamp < (int64_t)ctx->config.scan_cache_max_age_ms * 1000)
+        {
+            ESP_LOGI(_tag, "Scan served from cache (results:%u)", (unsigned int)ctx->scan_cache.count);
+            for (size_t i = 0; i < ctx->scan_cache.count && _aos_wifi_client_scan_waiter_deliver(&waiter, &ctx->scan_cache.results[i]); i++)
+                ;
+            _aos_wifi_client_scan_waiter_resolve(task, &waiter, AOS_WIFI_CLIENT_ERR_NONE);
+            break;
+        }
+
+        // Attach to the running scan, if any
+        if (ctx->scan_waiters_count >= CONFIG_AOS_WIFI_CLIENT_SCAN_WAITERS)
+        {
+            ESP_LOGW(_tag, "Too many concurrent scan requests (max:%u)", CONFIG_AOS_WIFI_CLIENT_SCAN_WAITERS);
+            _aos_wifi_client_scan_waiter_resolve(task, &waiter, AOS_WIFI_CLIENT_ERR_BUSY);
+            break;
+        }
+        if (waiter.deadline)
+            _aos_wifi_client_deadline_arm(ctx);
+        if (ctx->scanning)
+        {
+            // Only identical scans can be shared, different ones wait for the running scan to finish
+            waiter.active = !memcmp(&waiter.spec, &ctx->scan_spec, sizeof(waiter.spec));
+            ctx->scan_waiters[ctx->scan_waiters_count++] = waiter;
+            ESP_LOGI(_tag, "%s running scan (waiters:%u)", waiter.active ? "Joining" : "Queued behind", (unsigned int)ctx->scan_waiters_count);
+            break;
+        }
+        ctx->scan_waiters[ctx->scan_waiters_count++] = waiter;
+        _aos_wifi_client_scan_next(task);
+        break;
+    }
+    }
+}
+
+static void _aos_wifi_client_scan_next(aos_task_t *task)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    if (!ctx->scan_waiters_count)
+        return;
+
+    // Scan for the oldest queued request, serving every request with the same spec at once
+    ctx->scan_spec = ctx->scan_waiters[0].spec;
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+        ctx->scan_waiters[i].active = !memcmp(&ctx->scan_waiters[i].spec, &ctx->scan_spec, sizeof(ctx->scan_spec));
+
+    const _aos_wifi_client_scan_spec_t *spec = &ctx->scan_spec;
+    wifi_scan_config_t config = {
+        .ssid = spec->ssid[0] ? (uint8_t *)spec->ssid : NULL,
+        .bssid = spec->bssid_set ? (uint8_t *)spec->bssid : NULL,
+        .channel = spec->channel,
+        .show_hidden = spec->show_hidden,
+        .scan_type = spec->passive ? WIFI_SCAN_TYPE_PASSIVE : WIFI_SCAN_TYPE_ACTIVE,
+    };
+    if (spec->passive)
+        config.scan_time.passive = spec->max_dwell_ms;
+    else
+    {
+        config.scan_time.active.min = spec->min_dwell_ms;
+        config.scan_time.active.max = spec->max_dwell_ms;
+    }
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+    if (!spec->channel)
+        config.channel_bitmap.ghz_2_channels = spec->channel_bitmap;
+#endif
+
+    esp_err_t err = _driver->scan_start(_aos_wifi_client_scan_spec_isdefault(spec) ? NULL : &config, false);
+    if (err != ESP_OK)
+    {
+        // We cannot scan while connecting according to documentation, queued requests would fail alike
+        ESP_LOGE(_tag, "Could not start scan (ESP_error:%s)", esp_err_to_name(err));
+        for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+            ctx->scan_waiters[i].active = true;
+        _aos_wifi_client_scan_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+        return;
+    }
+    ctx->scanning = true;
+    _aos_wifi_client_stats_scan_begin(ctx);
+    ESP_LOGI(_tag, "Scanning (channel:%u channel_bitmap:0x%04x passive:%u)", spec->channel, spec->channel_bitmap, spec->passive);
+}
+
+static void _aos_wifi_client_scan_spec_set(_aos_wifi_client_scan_spec_t *spec, const aos_wifi_client_scan_spec_t *in_spec)
+{
+    // Zero everything, specs are compared bytewise
+    memset(spec, 0, sizeof(*spec));
+    if (!in_spec)
+        return;
+    if (in_spec->ssid)
+        strncpy((char *)spec->ssid, in_spec->ssid, sizeof(spec->ssid) - 1);
+    if (in_spec->bssid)
+    {
+        memcpy(spec->bssid, in_spec->bssid, sizeof(spec->bssid));
+        spec->bssid_set = true;
+    }
+    spec->channel = in_spec->channel;
+    spec->channel_bitmap = in_spec->channel ? 0 : in_spec->channel_bitmap & 0x7FFE;
+    // A single channel bitmap is a channel, which every driver version can scan directly
+    if (spec->channel_bitmap && !(spec->channel_bitmap & (spec->channel_bitmap - 1)))
+    {
+        spec->channel = __builtin_ctz(spec->channel_bitmap);
+        spec->channel_bitmap = 0;
+    }
+    spec->passive = in_spec->passive;
+    spec->min_dwell_ms = in_spec->min_dwell_ms;
+    spec->max_dwell_ms = in_spec->max_dwell_ms;
+    spec->show_hidden = in_spec->show_hidden;
+}
+
+static bool _aos_wifi_client_scan_spec_isdefault(const _aos_wifi_client_scan_spec_t *spec)
+{
+    static const _aos_wifi_client_scan_spec_t empty = {0};
+    return !memcmp(spec, &empty, sizeof(empty));
+}
+
+static bool _aos_wifi_client_scan_waiter_deliver(_aos_wifi_client_scan_waiter_t *waiter, const aos_wifi_client_scan_result_t *result)
+{
+    if (waiter->done)
+        return false;
+    if (waiter->kind != AOS_WIFI_CLIENT_SCAN_RESULTS)
+    {
+        waiter->count++;
+        waiter->done = !waiter->callback(result, waiter->arg);
+    }
+    else
+    {
+        if (waiter->count < waiter->results_size)
+            waiter->results[waiter->count++] = *result;
+        waiter->done = waiter->count >= waiter->results_size;
+    }
+    return !waiter->done;
+}
+
+static bool _aos_wifi_client_scan_fanout(const wifi_ap_record_t *record, void *arg)
+{
+    _aos_wifi_client_ctx_t *ctx = arg;
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 3, 0)
+    // Drivers without channel bitmap support scanned every channel
+    if (ctx->scan_spec.channel_bitmap && !(ctx->scan_spec.channel_bitmap & (1 << record->primary)))
+        return true;
+#endif
+    aos_wifi_client_scan_result_t result;
+    _aos_wifi_client_scan_result_from_record(record, &result);
+
+    bool more = false;
+    if (ctx->config.scan_cache_max_age_ms && _aos_wifi_client_scan_spec_isdefault(&ctx->scan_spec) &&
+        ctx->scan_cache.count < CONFIG_AOS_WIFI_CLIENT_SCAN_CACHE_SIZE)
+    {
+        ctx->scan_cache.results[ctx->scan_cache.count++] = result;
+        more = ctx->scan_cache.count < CONFIG_AOS_WIFI_CLIENT_SCAN_CACHE_SIZE;
+    }
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+        if (ctx->scan_waiters[i].active)
+            more |= _aos_wifi_client_scan_waiter_deliver(&ctx->scan_waiters[i], &result);
+    return more;
+}
+
+static void _aos_wifi_client_onscandone(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    switch (ctx->state)
+    {
+    case AOS_WIFI_CLIENT_STATE_CONNECTED:
+    case AOS_WIFI_CLIENT_STATE_DISCONNECTED:
+    case AOS_WIFI_CLIENT_STATE_CONNECTING:
+    case AOS_WIFI_CLIENT_STATE_RECONNECTING:
+    {
+        ctx->scanning = false;
+        if (!ctx->scan_waiters_count)
+        {
+            // We need to call this to free memory in the driver according to esp_wifi_scan_start docs
+            esp_err_t err = _aos_wifi_client_scan_clear();
+            ESP_LOGW(_tag, "Could not find scan future, cleaning up (ESP_error:%s)", esp_err_to_name(err));
+            break;
+        }
+
+        // Hand results over to every waiter and the cache, one record at a time
+        bool survey = _aos_wifi_client_scan_spec_isdefault(&ctx->scan_spec);
+        if (survey)
+        {
+            ctx->scan_cache.valid = false;
+            ctx->scan_cache.count = 0;
+        }
+        esp_err_t err = _aos_wifi_client_scan_foreach(_aos_wifi_client_scan_fanout, ctx);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(_tag, "Could not get AP records (ESP_error:%s)", esp_err_to_name(err));
+            _aos_wifi_client_scan_resolve(task, err == ESP_ERR_NO_MEM ? AOS_WIFI_CLIENT_ERR_FAIL : AOS_WIFI_CLIENT_ERR_DRIVER);
+            _aos_wifi_client_scan_next(task);
+            break;
+        }
+        _aos_wifi_client_stats_scan_end(ctx);
+        if (survey)
+        {
+            ctx->scan_cache.timestamp = esp_timer_get_time();
+            ctx->scan_cache.valid = ctx->config.scan_cache_max_age_ms > 0;
+        }
+        ESP_LOGI(_tag, "Scan done (waiters:%u)", (unsigned int)ctx->scan_waiters_count);
+        _aos_wifi_client_scan_resolve(task, AOS_WIFI_CLIENT_ERR_NONE);
+        _aos_wifi_client_scan_next(task);
+        break;
+    }
+    }
+}
+
+static void _aos_wifi_client_disconnect(aos_task_t *task)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_link_reset(task);
+    _aos_wifi_client_connect_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+}
+
+static void _aos_wifi_client_link_reset(aos_task_t *task)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    // The driver only reports the leave when associated or associating
+    if (ctx->state != AOS_WIFI_CLIENT_STATE_DISCONNECTED && !ctx->retry_pending && !(ctx->roam.in_progress && ctx->roam.left))
+        ctx->leaving = true;
+    _driver->disconnect();
+    if (ctx->retry_pending)
+    {
+        xTimerStop(ctx->retry_timer, 0);
+        ctx->retry_pending = false;
+    }
+    xTimerStop(ctx->roam.timer, 0);
+    ctx->roam.in_progress = false;
+    xTimerStop(ctx->link.timer, 0);
+}
+
+static void _aos_wifi_client_stopcurrentscan(aos_task_t *task)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    ctx->scan_cache.valid = false;
+    if (ctx->scanning)
+    {
+        esp_err_t err0 = _driver->scan_stop();
+        // Cleanup incomplete scan results
+        esp_err_t err1 = _aos_wifi_client_scan_clear();
+        ESP_LOGD(_tag, "Stopped scan (scan_stop:%s clear:%s)", esp_err_to_name(err0), esp_err_to_name(err1));
+        ctx->scanning = false;
+    }
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+        ctx->scan_waiters[i].active = true;
+    _aos_wifi_client_scan_resolve(task, AOS_WIFI_CLIENT_ERR_FAIL);
+}
+
+static void _aos_wifi_client_scan_expire(aos_task_t *task, int64_t now)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    size_t kept = 0;
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+    {
+        _aos_wifi_client_scan_waiter_t waiter = ctx->scan_waiters[i];
+        if (waiter.deadline && waiter.deadline <= now)
+        {
+            ESP_LOGW(_tag, "Scan request timed out (%s)", waiter.active ? "running" : "queued");
+            _aos_wifi_client_scan_waiter_resolve(task, &waiter, AOS_WIFI_CLIENT_ERR_TIMEOUT);
+        }
+        else
+            ctx->scan_waiters[kept++] = waiter;
+    }
+    ctx->scan_waiters_count = kept;
+    _aos_wifi_client_scan_orphaned(task);
+}
+
+static void _aos_wifi_client_scan_orphaned(aos_task_t *task)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    if (!ctx->scanning)
+        return;
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+        if (ctx->scan_waiters[i].active)
+            return;
+
+    // Nobody is served by the running scan anymore, free the radio for queued requests and connections
+    esp_err_t err0 = _driver->scan_stop();
+    esp_err_t err1 = _aos_wifi_client_scan_clear();
+    ESP_LOGI(_tag, "Stopped orphaned scan (scan_stop:%s clear:%s)", esp_err_to_name(err0), esp_err_to_name(err1));
+    ctx->scanning = false;
+    _aos_wifi_client_scan_next(task);
+}
+
+static void _aos_wifi_client_scan_resolve(aos_task_t *task, uint32_t err)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    // Resolve the waiters served by the last scan, keeping queued ones in order
+    size_t queued = 0;
+    for (size_t i = 0; i < ctx->scan_waiters_count; i++)
+    {
+        if (ctx->scan_waiters[i].active)
+            _aos_wifi_client_scan_waiter_resolve(task, &ctx->scan_waiters[i], err);
+        else
+            ctx->scan_waiters[queued++] = ctx->scan_waiters[i];
+    }
+    ctx->scan_waiters_count = queued;
+}
+
+static void _aos_wifi_client_scan_waiter_resolve(aos_task_t *task, _aos_wifi_client_scan_waiter_t *waiter, uint32_t err)
+{
+    switch (waiter->kind)
+    {
+    case AOS_WIFI_CLIENT_SCAN_RESULTS:
+    {
+        AOS_ARGS_T(aos_wifi_client_scan) *args = aos_args_get(waiter->future);
+        args->out_results_count = waiter->count;
+        args->out_err = err;
+        break;
+    }
+    case AOS_WIFI_CLIENT_SCAN_STREAM:
+    {
+        AOS_ARGS_T(aos_wifi_client_scan_stream) *args = aos_args_get(waiter->future);
+        args->out_results_count = waiter->count;
+        args->out_err = err;
+        break;
+    }
+    case AOS_WIFI_CLIENT_SCAN_CANDIDATES:
+    {
+        // The scan was only the first step, continue with the connection
+        if (err == AOS_WIFI_CLIENT_ERR_NONE)
+        {
+            _aos_wifi_client_candidates_ready(task, waiter->future, waiter->deadline);
+            return;
+        }
+        _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+        if (ctx->best_future == waiter->future)
+            ctx->best_future = NULL;
+        AOS_ARGS_T(aos_wifi_client_connect_best) *args = aos_args_get(waiter->future);
+        args->out_err = err;
+        break;
+    }
+    case AOS_WIFI_CLIENT_SCAN_ROAM:
+    {
+        _aos_wifi_client_roam_evaluate(task, err);
+        return;
+    }
+    }
+    aos_resolve(waiter->future);
+}
+
+static esp_err_t _aos_wifi_client_scan_foreach(bool (*callback)(const wifi_ap_record_t *record, void *arg), void *arg)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    uint16_t count = 0;
+    esp_err_t err = _driver->scan_get_ap_num(&count);
+    if (err != ESP_OK || !count)
+    {
+        _aos_wifi_client_scan_clear();
+        return err;
+    }
+
+    if (_driver->scan_get_ap_record)
+    {
+        // Pop records one by one, constant memory regardless of how many APs are visible
+        wifi_ap_record_t record;
+        for (uint16_t i = 0; i < count; i++)
+        {
+            err = _driver->scan_get_ap_record(&record);
+            if (err != ESP_OK || !callback(&record, arg))
+                break;
+        }
+        _aos_wifi_client_scan_clear();
+        return err;
+    }
+
+    // Older drivers can only hand over all records at once
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATIC
+    wifi_ap_record_t *records = _scan_records;
+    if (count > CONFIG_AOS_WIFI_CLIENT_STATIC_SCAN_RECORDS)
+    {
+        ESP_LOGW(_tag, "Scan records truncated (found:%u max:%u)", count, CONFIG_AOS_WIFI_CLIENT_STATIC_SCAN_RECORDS);
+        count = CONFIG_AOS_WIFI_CLIENT_STATIC_SCAN_RECORDS;
+    }
+#else
+    wifi_ap_record_t *records = calloc(count, sizeof(wifi_ap_record_t));
+    if (!records)
+    {
+        _aos_wifi_client_scan_clear();
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+    err = _driver->scan_get_ap_records(&count, records);
+    for (uint16_t i = 0; err == ESP_OK && i < count && callback(&records[i], arg); i++)
+        ;
+#ifndef CONFIG_AOS_WIFI_CLIENT_STATIC
+    free(records);
+#endif
+    return err;
+}
+
+static esp_err_t _aos_wifi_client_scan_clear(void)
+{
+    if (_driver->clear_ap_list)
+        return _driver->clear_ap_list();
+
+    uint16_t n = 0;
+    wifi_ap_record_t m = {};
+    return _driver->scan_get_ap_records(&n, &m);
+}
+
+static void _aos_wifi_client_scan_result_from_record(const wifi_ap_record_t *record, aos_wifi_client_scan_result_t *result)
+{
+    memset(result->ssid, 0, sizeof(result->ssid));
+    strncpy(result->ssid, (char *)record->ssid, sizeof(record->ssid) / sizeof(char));
+    result->open = record->authmode == WIFI_AUTH_OPEN ? 1 : 0; // TODO: Likely we want something more elaborate here
+    result->strength = ((float)record->rssi / INT8_MAX) + 1;   // TODO: Assess this is the correct scale, RSSI scale depends on manufacturer and no docs could be found in IDF
+    memcpy(result->bssid, record->bssid, sizeof(result->bssid));
+    result->rssi = record->rssi;
+    result->channel = record->primary;
+}
+
+static esp_err_t _aos_wifi_client_retry(aos_task_t *task, unsigned int attempt, bool immediate)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    uint32_t delay_ms = immediate ? 0 : _aos_wifi_client_backoff_delay(&ctx->config.backoff, attempt);
+    TickType_t delay = pdMS_TO_TICKS(delay_ms);
+    if (!delay)
+        return _driver->connect();
+
+    ESP_LOGI(_tag, "Retrying in %ums (attempt:%u)", delay_ms, attempt);
+    ctx->retry_seq++;
+    ctx->retry_pending = true;
+    if (xTimerChangePeriod(ctx->retry_timer, delay, 0) != pdPASS)
+    {
+        ctx->retry_pending = false;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static uint32_t _aos_wifi_client_backoff_delay(const aos_wifi_client_backoff_t *backoff, unsigned int attempt)
+{
+    if (!backoff->initial_delay_ms)
+        return 0;
+
+    float multiplier = backoff->multiplier < 1 ? 1 : backoff->multiplier;
+    float limit = backoff->max_delay_ms ? backoff->max_delay_ms : UINT32_MAX;
+    float delay = backoff->initial_delay_ms;
+    for (unsigned int i = 1; i < attempt && delay < limit && multiplier > 1; i++)
+        delay *= multiplier;
+    if (delay > limit)
+        delay = limit;
+
+    // Spread uniformly within +/- jitter_pct
+    unsigned int jitter_pct = backoff->jitter_pct > 100 ? 100 : backoff->jitter_pct;
+    if (jitter_pct)
+    {
+        float spread = delay * jitter_pct / 100;
+        delay += ((float)esp_random() / UINT32_MAX) * 2 * spread - spread;
+    }
+    return delay < UINT32_MAX ? (uint32_t)delay : UINT32_MAX;
+}
+
+static _aos_wifi_client_policy_t _aos_wifi_client_policy_get(uint8_t reason)
+{
+    for (size_t i = 0; i < sizeof(_aos_wifi_client_policies) / sizeof(_aos_wifi_client_policies[0]); i++)
+    {
+        if (_aos_wifi_client_policies[i].reason == reason)
+            return _aos_wifi_client_policies[i].policy;
+    }
+    return AOS_WIFI_CLIENT_POLICY_BACKOFF;
+}
+
+static wifi_ps_type_t _aos_wifi_client_ps_get(aos_wifi_client_power_mode_t mode)
+{
+    switch (mode)
+    {
+    case AOS_WIFI_CLIENT_POWER_BALANCED:
+        return WIFI_PS_MIN_MODEM;
+    case AOS_WIFI_CLIENT_POWER_SAVING:
+        return WIFI_PS_MAX_MODEM;
+    case AOS_WIFI_CLIENT_POWER_PERFORMANCE:
+    default:
+        return WIFI_PS_NONE;
+    }
+}
+
+static void _aos_wifi_client_retry_timer_cb(TimerHandle_t timer)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = pvTimerGetTimerID(timer);
+    _aos_wifi_client_notification_data_t data = {.retry_seq = ctx->retry_seq};
+    _aos_wifi_client_timer_post(AOS_WIFI_CLIENT_EVT_RETRY, &data);
+}
+
+static bool _aos_wifi_client_hint_apply(_aos_wifi_client_ctx_t *ctx, wifi_config_t *config)
+{
+    if (!ctx->hint.valid ||
+        strncmp((char *)ctx->hint.ssid, (char *)config->sta.ssid, sizeof(config->sta.ssid) / sizeof(char)))
+        return false;
+
+    config->sta.bssid_set = true;
+    memcpy(config->sta.bssid, ctx->hint.bssid, sizeof(config->sta.bssid));
+    config->sta.channel = ctx->hint.channel;
+    config->sta.threshold.authmode = ctx->hint.authmode;
+    return true;
+}
+
+static esp_err_t _aos_wifi_client_hint_set(_aos_wifi_client_ctx_t *ctx, bool use)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    wifi_config_t config = {};
+    esp_err_t err = _driver->get_config(ESP_IF_WIFI_STA, &config);
+    if (err != ESP_OK)
+        return err;
+
+    // Clear any previous hint, then apply the current one if requested and available
+    config.sta.bssid_set = false;
+    memset(config.sta.bssid, 0, sizeof(config.sta.bssid));
+    config.sta.channel = 0;
+    config.sta.threshold.authmode = WIFI_AUTH_OPEN;
+    ctx->fastpath = use && _aos_wifi_client_hint_apply(ctx, &config);
+    return _driver->set_config(ESP_IF_WIFI_STA, &config);
+}
+
+static void _aos_wifi_client_hint_store(_aos_wifi_client_ctx_t *ctx)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    wifi_ap_record_t ap = {};
+    esp_err_t err = _driver->sta_get_ap_info(&ap);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(_tag, "Could not get AP info, hint not stored (ESP_error:%s)", esp_err_to_name(err));
+        ctx->hint.valid = false;
+        return;
+    }
+    memcpy(ctx->hint.ssid, ap.ssid, sizeof(ctx->hint.ssid));
+    memcpy(ctx->hint.bssid, ap.bssid, sizeof(ctx->hint.bssid));
+    ctx->hint.channel = ap.primary;
+    ctx->hint.authmode = ap.authmode;
+    ctx->hint.valid = true;
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+    _resume.hint = ctx->hint;
+#endif
+
+    // Published along with the state
+    memcpy(ctx->status.bssid, ap.bssid, sizeof(ctx->status.bssid));
+    ctx->status.channel = ap.primary;
+    ctx->status.rssi = ap.rssi;
+}
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+static void _aos_wifi_client_lease_apply(_aos_wifi_client_ctx_t *ctx, const char *ssid)
+{
+    // Only on the path straight to the AP the lease was obtained from, a scan would cost more than DHCP saves anyway
+    time_t age = time(NULL) - _resume.lease_time;
+    bool reuse = _driver->static_ip_set && ctx->fastpath && _resume.lease_valid &&
+                 age >= 0 && age < CONFIG_AOS_WIFI_CLIENT_RESUME_LEASE_S &&
+                 !strncmp((char *)_resume.hint.ssid, ssid, sizeof(_resume.hint.ssid));
+    if (!reuse)
+    {
+        _aos_wifi_client_lease_drop(ctx);
+        return;
+    }
+    esp_err_t err = _driver->static_ip_set(ctx->netif, &_resume.lease);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(_tag, "Could not reuse lease (ESP_error:%s)", esp_err_to_name(err));
+        _aos_wifi_client_lease_drop(ctx);
+        return;
+    }
+    ESP_LOGI(_tag, "Reusing lease (age_s:%ld)", (long)age);
+    ctx->lease_reused = true;
+}
+
+static void _aos_wifi_client_lease_drop(_aos_wifi_client_ctx_t *ctx)
+{
+    if (!ctx->lease_reused)
+        return;
+    ESP_LOGI(_tag, "Dropping reused lease, back to DHCP");
+    ctx->lease_reused = false;
+    _resume.lease_valid = false;
+    esp_err_t err = _driver->static_ip_set(ctx->netif, NULL);
+    if (err != ESP_OK)
+        ESP_LOGE(_tag, "Could not restore DHCP (ESP_error:%s)", esp_err_to_name(err));
+}
+#endif
+
+void aos_wifi_client_resume_invalidate(void)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_RESUME
+    _resume.lease_valid = false;
+#endif
+}
+
+// Called with the pool lock held, returns -1 when the pool is empty
+static int _aos_wifi_client_pool_take(_aos_wifi_client_ctx_t *ctx)
+{
+    _aos_wifi_client_pool_t *pool = &ctx->pool;
+    if (!pool->free_mask)
+        return -1;
+    uint8_t slot = __builtin_ctz(pool->free_mask);
+    pool->free_mask &= ~(1UL << slot);
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    uint32_t used = CONFIG_AOS_WIFI_CLIENT_EVENT_POOLSIZE - __builtin_popcount(pool->free_mask);
+    if (used > ctx->stats.stats.pool_hwm)
+        ctx->stats.stats.pool_hwm = used;
+#endif
+    return slot;
+}
+
+#ifndef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+// Only the event loop may wait for the client queue, timer callbacks must not
+static void _aos_wifi_client_forward(_aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data, bool wait)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(_task);
+    _aos_wifi_client_pool_t *pool = &ctx->pool;
+
+    taskENTER_CRITICAL(&pool->lock);
+    int slot = _aos_wifi_client_pool_take(ctx);
+    if (slot < 0)
+    {
+        // Keep the notification, it is replayed as soon as a future is released
+        pool->exhausted++;
+        _aos_wifi_client_pool_defer(pool, evt, data);
+        taskEXIT_CRITICAL(&pool->lock);
+        ESP_LOGW(_tag, "Event pool exhausted, deferring notification (evt:%u exhausted:%u)", evt, pool->exhausted);
+        return;
+    }
+    taskEXIT_CRITICAL(&pool->lock);
+
+    aos_future_t *future = pool->futures[slot];
+    AOS_ARGS_T(_aos_wifi_client_notification) *args = aos_args_get(future);
+    args->evt = evt;
+    args->data = *data;
+    // Keep a spare entry for start and stop, which do not go through the counted send
+    if (_aos_wifi_client_enqueue(evt, future, wait ? UINT32_MAX : CONFIG_AOS_WIFI_CLIENT_TASK_QUEUESIZE - 1))
+        return;
+
+    // The slot goes back to the pool, the notification is kept and resent by the timer
+    taskENTER_CRITICAL(&pool->lock);
+    pool->free_mask |= 1UL << slot;
+    _aos_wifi_client_pool_defer(pool, evt, data);
+    taskEXIT_CRITICAL(&pool->lock);
+    xTimerReset(pool->timer, 0);
+    ESP_LOGW(_tag, "Could not send notification, deferring it (evt:%u)", evt);
+}
+
+static void _aos_wifi_client_pool_timer_cb(TimerHandle_t timer)
+{
+    _aos_wifi_client_ctx_t *ctx = pvTimerGetTimerID(timer);
+    _aos_wifi_client_pool_t *pool = &ctx->pool;
+
+    // A single notification getting through is enough, the others are replayed once its future is released
+    taskENTER_CRITICAL(&pool->lock);
+    if (!pool->lost_mask)
+    {
+        taskEXIT_CRITICAL(&pool->lock);
+        return;
+    }
+    uint8_t evt = __builtin_ctz(pool->lost_mask);
+    for (uint8_t i = evt + 1; i < AOS_WIFI_CLIENT_EVT_MAX; i++)
+    {
+        if (pool->lost_mask & (1UL << i) && (int32_t)(pool->lost_seq[i] - pool->lost_seq[evt]) < 0)
+            evt = i;
+    }
+    pool->lost_mask &= ~(1UL << evt);
+    _aos_wifi_client_notification_data_t data = pool->lost[evt];
+    taskEXIT_CRITICAL(&pool->lock);
+
+    _aos_wifi_client_forward(evt, &data, false);
+}
+
+// Called with the pool lock held
+static void _aos_wifi_client_pool_defer(_aos_wifi_client_pool_t *pool, _aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data)
+{
+    pool->lost_mask |= 1UL << evt;
+    pool->lost_seq[evt] = pool->seq++;
+    pool->lost[evt] = *data;
+}
+#endif
+
+static void _aos_wifi_client_pool_release(aos_task_t *task, uint8_t slot)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    _aos_wifi_client_pool_t *pool = &ctx->pool;
+    uint32_t lost_seq[AOS_WIFI_CLIENT_EVT_MAX];
+    _aos_wifi_client_notification_data_t lost[AOS_WIFI_CLIENT_EVT_MAX];
+
+    taskENTER_CRITICAL(&pool->lock);
+    pool->free_mask |= 1UL << slot;
+    uint32_t lost_mask = pool->lost_mask;
+    pool->lost_mask = 0;
+    memcpy(lost_seq, pool->lost_seq, sizeof(lost_seq));
+    memcpy(lost, pool->lost, sizeof(lost));
+    taskEXIT_CRITICAL(&pool->lock);
+
+    if (lost_mask)
+        ESP_LOGI(_tag, "Replaying deferred notifications (mask:0x%08lx)", (unsigned long)lost_mask);
+    _aos_wifi_client_replay(task, lost_mask, lost_seq, lost);
+}
+
+// Handle notifications stored one per type, in the order they arrived
+static void _aos_wifi_client_replay(aos_task_t *task, uint32_t mask, const uint32_t *seq, const _aos_wifi_client_notification_data_t *data)
+{
+    while (mask)
+    {
+        uint8_t evt = __builtin_ctz(mask);
+        for (uint8_t i = evt + 1; i < AOS_WIFI_CLIENT_EVT_MAX; i++)
+        {
+            if (mask & (1UL << i) && (int32_t)(seq[i] - seq[evt]) < 0)
+                evt = i;
+        }
+        mask &= ~(1UL << evt);
+        ESP_LOGD(_tag, "Handling stored notification (evt:%u)", evt);
+        _aos_wifi_client_notification_handlers[evt](task, &data[evt]);
+    }
+}
+
+// Forward a driver event from the event loop, or a timer notification through the lane
+static void _aos_wifi_client_post(_aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(_task);
+    _aos_wifi_client_lane_t *lane = &ctx->lane;
+
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    if (lane->pending_mask & (1UL << evt))
+        ctx->event_stats.coalesced++;
+    lane->pending_mask |= 1UL << evt;
+    lane->seq[evt] = lane->next_seq++;
+    lane->data[evt] = *data;
+    bool ring = !lane->doorbell;
+    lane->doorbell = true;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+
+    if (ring && !_aos_wifi_client_lane_ring(ctx))
+        ESP_LOGW(_tag, "Could not wake up client task, event left pending (evt:%u)", evt);
+#else
+    _aos_wifi_client_forward(evt, data, true);
+#endif
+}
+
+// Forward a timer notification, the timer service task must never wait for the client queue
+static void _aos_wifi_client_timer_post(_aos_wifi_client_evt_t evt, const _aos_wifi_client_notification_data_t *data)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_post(evt, data);
+#else
+    _aos_wifi_client_forward(evt, data, false);
+#endif
+}
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+static void _aos_wifi_client_onlane(aos_task_t *task, const _aos_wifi_client_notification_data_t *data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    // Events stored after this ring a new doorbell
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    ctx->lane.doorbell = false;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+    _aos_wifi_client_lane_drain(task);
+}
+
+static void _aos_wifi_client_lane_drain(aos_task_t *task)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    _aos_wifi_client_lane_t *lane = &ctx->lane;
+    uint32_t seq[AOS_WIFI_CLIENT_EVT_MAX];
+    _aos_wifi_client_notification_data_t data[AOS_WIFI_CLIENT_EVT_MAX];
+
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    uint32_t mask = lane->pending_mask;
+    lane->pending_mask = 0;
+    memcpy(seq, lane->seq, sizeof(seq));
+    memcpy(data, lane->data, sizeof(data));
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+
+    _aos_wifi_client_replay(task, mask, seq, data);
+}
+
+// Never blocks, neither the event loop nor the timer service task may wait for the client queue
+static bool _aos_wifi_client_lane_ring(_aos_wifi_client_ctx_t *ctx)
+{
+    _aos_wifi_client_lane_t *lane = &ctx->lane;
+
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    int slot = _aos_wifi_client_pool_take(ctx);
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+    if (slot >= 0)
+    {
+        aos_future_t *future = ctx->pool.futures[slot];
+        AOS_ARGS_T(_aos_wifi_client_notification) *args = aos_args_get(future);
+        args->evt = AOS_WIFI_CLIENT_EVT_LANE;
+        args->data = (_aos_wifi_client_notification_data_t){};
+        // Keep a spare entry for start and stop, which do not go through the counted send
+        if (_aos_wifi_client_enqueue(AOS_WIFI_CLIENT_EVT_LANE, future, CONFIG_AOS_WIFI_CLIENT_TASK_QUEUESIZE - 1))
+            return true;
+    }
+
+    // Events stay pending, the next one or the retry timer rings again
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    if (slot >= 0)
+        ctx->pool.free_mask |= 1UL << slot;
+    lane->doorbell = false;
+    ctx->event_stats.wakeups_failed++;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+    xTimerReset(lane->timer, 0);
+    return false;
+}
+
+static void _aos_wifi_client_lane_timer_cb(TimerHandle_t timer)
+{
+    _aos_wifi_client_ctx_t *ctx = pvTimerGetTimerID(timer);
+    _aos_wifi_client_lane_t *lane = &ctx->lane;
+
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    bool ring = lane->pending_mask && !lane->doorbell;
+    if (ring)
+        lane->doorbell = true;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+
+    if (ring && !_aos_wifi_client_lane_ring(ctx))
+        ESP_LOGW(_tag, "Could not wake up client task, retrying");
+}
+#endif
+
+static esp_err_t _aos_wifi_client_events_register(_aos_wifi_client_ctx_t *ctx)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+
+    // Subscribe only to what the configured features use, every subscription wakes the event loop task
+    ctx->wifi_events_count = 0;
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_ANY
+    ctx->wifi_event_ids[ctx->wifi_events_count++] = ESP_EVENT_ANY_ID;
+#else
+    ctx->wifi_event_ids[ctx->wifi_events_count++] = WIFI_EVENT_STA_DISCONNECTED;
+    ctx->wifi_event_ids[ctx->wifi_events_count++] = WIFI_EVENT_SCAN_DONE;
+    if (ctx->config.roaming.rssi_threshold)
+        ctx->wifi_event_ids[ctx->wifi_events_count++] = WIFI_EVENT_STA_BSS_RSSI_LOW;
+
+    // Stop the driver from posting the maskable events (e.g. probe requests) altogether, none of them is used. The mask
+    // is shared with the rest of the firmware, thus only changed if it can be restored.
+    esp_err_t err = _driver->get_event_mask(&ctx->wifi_event_mask);
+    if (err == ESP_OK)
+        err = _driver->set_event_mask(WIFI_EVENT_MASK_ALL);
+    ctx->wifi_event_mask_set = err == ESP_OK;
+    if (err != ESP_OK)
+        ESP_LOGW(_tag, "Could not set event mask (ESP_error:%s)", esp_err_to_name(err));
+#endif
+
+    for (size_t i = 0; i < ctx->wifi_events_count; i++)
+    {
+        esp_err_t err = esp_event_handler_instance_register(WIFI_EVENT, ctx->wifi_event_ids[i], _aos_wifi_client_event_handler, NULL, &ctx->wifi_handler_instances[i]);
+        if (err != ESP_OK)
+        {
+            ctx->wifi_events_count = i;
+            _aos_wifi_client_events_unregister(ctx);
+            return err;
+        }
+    }
+    esp_err_t ip_err = esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, _aos_wifi_client_event_handler, NULL, &ctx->ip_handler_instance);
+    if (ip_err != ESP_OK)
+        _aos_wifi_client_events_unregister(ctx);
+    return ip_err;
+}
+
+static void _aos_wifi_client_events_unregister(_aos_wifi_client_ctx_t *ctx)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    for (size_t i = 0; i < ctx->wifi_events_count; i++)
+    {
+        esp_event_handler_instance_unregister(WIFI_EVENT, ctx->wifi_event_ids[i], ctx->wifi_handler_instances[i]);
+        ctx->wifi_handler_instances[i] = NULL;
+    }
+    ctx->wifi_events_count = 0;
+    if (ctx->wifi_event_mask_set)
+    {
+        esp_err_t err = _driver->set_event_mask(ctx->wifi_event_mask);
+        if (err != ESP_OK)
+            ESP_LOGW(_tag, "Could not restore event mask (ESP_error:%s)", esp_err_to_name(err));
+        ctx->wifi_event_mask_set = false;
+    }
+    if (ctx->ip_handler_instance)
+    {
+        esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, ctx->ip_handler_instance);
+        ctx->ip_handler_instance = NULL;
+    }
+}
+
+AOS_DEFINE(aos_wifi_client_event_stats_get, aos_wifi_client_event_stats_t)
+aos_future_t *aos_wifi_client_event_stats_get(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_EVENT_STATS_GET, future);
+}
+static void _aos_wifi_client_event_stats_get_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    AOS_ARGS_T(aos_wifi_client_event_stats_get) *args = aos_args_get(future);
+
+    // Counters are updated by the event loop task, copy under the pool lock to get a consistent snapshot
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    args->out_stats = ctx->event_stats;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+    aos_resolve(future);
+}
+
+static void _aos_wifi_client_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    ESP_LOGD(_tag, "event_base:%s event_id:%d", event_base, event_id);
+    int64_t begin = esp_timer_get_time();
+    if (event_base == WIFI_EVENT)
+    {
+        if (event_id == WIFI_EVENT_STA_DISCONNECTED)
+        {
+            wifi_event_sta_disconnected_t *event = event_data;
+            _aos_wifi_client_notification_data_t data = {.disconnected = {.reason = event->reason, .rssi = event->rssi}};
+            _aos_wifi_client_post(AOS_WIFI_CLIENT_EVT_DISCONNECTED, &data);
+        }
+        else if (event_id == WIFI_EVENT_SCAN_DONE)
+        {
+            _aos_wifi_client_notification_data_t data = {};
+            _aos_wifi_client_post(AOS_WIFI_CLIENT_EVT_SCANDONE, &data);
+        }
+        else if (event_id == WIFI_EVENT_STA_BSS_RSSI_LOW)
+        {
+            _aos_wifi_client_notification_data_t data = {.rssi = ((wifi_event_bss_rssi_low_t *)event_data)->rssi};
+            _aos_wifi_client_post(AOS_WIFI_CLIENT_EVT_RSSI_LOW, &data);
+        }
+    }
+    else if (event_base == IP_EVENT)
+    {
+        if (event_id == IP_EVENT_STA_GOT_IP)
+        {
+            // Event data only lives for the duration of this call, copy it
+            _aos_wifi_client_notification_data_t data = {.ip_info = ((ip_event_got_ip_t *)event_data)->ip_info};
+            _aos_wifi_client_post(AOS_WIFI_CLIENT_EVT_CONNECTED, &data);
+        }
+    }
+
+    // Account for the call
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(_task);
+    aos_wifi_client_event_stats_t *stats = &ctx->event_stats;
+    int64_t elapsed = esp_timer_get_time() - begin;
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    if (event_base == WIFI_EVENT && event_id >= 0 && event_id < AOS_WIFI_CLIENT_EVENT_STATS_IDS)
+        stats->wifi[event_id]++;
+    else if (event_base == WIFI_EVENT)
+        stats->wifi_other++;
+    else
+        stats->ip++;
+    stats->handler_us += elapsed;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+}
+
+AOS_DEFINE(aos_wifi_client_get_stats, aos_wifi_client_stats_t, uint32_t)
+aos_future_t *aos_wifi_client_get_stats(aos_future_t *future)
+{
+    return _aos_wifi_client_send(AOS_WIFI_CLIENT_EVT_GET_STATS, future);
+}
+static void _aos_wifi_client_get_stats_handler(aos_task_t *task, aos_future_t *future)
+{
+    ESP_LOGD(_tag, "%s", __FUNCTION__);
+    _aos_wifi_client_dequeued(task);
+    AOS_ARGS_T(aos_wifi_client_get_stats) *args = aos_args_get(future);
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+
+    // Counters shared with the event loop and callers are copied under the pool lock
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    args->out_stats = ctx->stats.stats;
+    args->out_stats.pool_exhausted = ctx->pool.exhausted;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+
+    // Account for the time spent in the current state so far
+    args->out_stats.state_ms[ctx->state] += (esp_timer_get_time() - ctx->stats.state_since) / 1000;
+    args->out_err = AOS_WIFI_CLIENT_ERR_NONE;
+#else
+    args->out_err = AOS_WIFI_CLIENT_ERR_FAIL;
+#endif
+    aos_resolve(future);
+}
+
+static aos_future_t *_aos_wifi_client_send(_aos_wifi_client_evt_t evt, aos_future_t *future)
+{
+    return _aos_wifi_client_enqueue(evt, future, UINT32_MAX);
+}
+
+/**
+ * Send a message counted in queued, without sending when limit messages are already counted. Messages leave the queue
+ * before their handler uncounts them, so a limit below the queue size guarantees that aos_task_send does not block.
  */
+static aos_future_t *_aos_wifi_client_enqueue(_aos_wifi_client_evt_t evt, aos_future_t *future, uint32_t limit)
+{
+    // AsyncRTOS does not expose the queue depth, count messages between send and handling instead
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(_task);
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    if (ctx->queued >= limit)
+    {
+        taskEXIT_CRITICAL(&ctx->pool.lock);
+        return NULL;
+    }
+    ctx->queued++;
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    if (ctx->queued > ctx->stats.stats.queue_hwm)
+        ctx->stats.stats.queue_hwm = ctx->queued;
+#endif
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+    aos_future_t *sent = aos_task_send(_task, evt, future);
+    if (!sent)
+    {
+        // Never handled, a stale count would keep link requests deferred
+        ESP_LOGE(_tag, "Could not send request (evt:%u)", evt);
+        taskENTER_CRITICAL(&ctx->pool.lock);
+        ctx->queued--;
+        taskEXIT_CRITICAL(&ctx->pool.lock);
+    }
+    return sent;
+}
+
+static void _aos_wifi_client_state_set(_aos_wifi_client_ctx_t *ctx, aos_wifi_client_state_t state)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    int64_t now = esp_timer_get_time();
+    ctx->stats.stats.state_ms[ctx->state] += (now - ctx->stats.state_since) / 1000;
+    ctx->stats.state_since = now;
+#endif
+    ctx->state = state;
+
+    if (state != AOS_WIFI_CLIENT_STATE_CONNECTED)
+        ctx->status = (aos_wifi_client_status_t){.generation = ctx->status.generation};
+    ctx->status.state = state;
+    _aos_wifi_client_status_publish(ctx);
+}
+
+static void _aos_wifi_client_status_publish(_aos_wifi_client_ctx_t *ctx)
+{
+    ctx->status.generation++;
+    uint32_t seq = __atomic_load_n(&_status.seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&_status.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    _status.status = ctx->status;
+    __atomic_store_n(&_status.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+bool aos_wifi_client_status_get(aos_wifi_client_status_t *status)
+{
+    bool isr = xPortInIsrContext();
+    for (int i = 0; i < _AOS_WIFI_CLIENT_STATUS_RETRIES; i++)
+    {
+        // A reader with a higher priority than the client task would otherwise spin while the writer is preempted
+        if (i && !isr)
+            vTaskDelay(1);
+        uint32_t seq = __atomic_load_n(&_status.seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        *status = _status.status;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&_status.seq, __ATOMIC_RELAXED) == seq)
+            return true;
+    }
+    return false;
+}
+
+// Returns the number of messages still queued behind the one being handled
+static inline uint32_t _aos_wifi_client_queue_pop(aos_task_t *task)
+{
+    _aos_wifi_client_ctx_t *ctx = aos_task_args_get(task);
+    taskENTER_CRITICAL(&ctx->pool.lock);
+    if (ctx->queued)
+        ctx->queued--;
+    uint32_t queued = ctx->queued;
+    taskEXIT_CRITICAL(&ctx->pool.lock);
+    return queued;
+}
+
+static inline void _aos_wifi_client_dequeued(aos_task_t *task)
+{
+    _aos_wifi_client_queue_pop(task);
+#ifdef CONFIG_AOS_WIFI_CLIENT_EVENT_LANE
+    _aos_wifi_client_lane_drain(task);
+#endif
+    _aos_wifi_client_intent_apply(task);
+}
+
+static inline void _aos_wifi_client_stats_histogram_add(aos_wifi_client_histogram_t *histogram, int64_t since)
+{
+    uint32_t ms = (esp_timer_get_time() - since) / 1000;
+    uint32_t bucket = ms >> 5 ? 32 - __builtin_clz(ms >> 5) : 0;
+    histogram->buckets[bucket < AOS_WIFI_CLIENT_STATS_BUCKETS ? bucket : AOS_WIFI_CLIENT_STATS_BUCKETS - 1]++;
+    histogram->count++;
+    histogram->sum_ms += ms;
+    if (ms > histogram->max_ms)
+        histogram->max_ms = ms;
+}
+
+static inline void _aos_wifi_client_stats_connect_begin(_aos_wifi_client_ctx_t *ctx)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    ctx->stats.connect_since = esp_timer_get_time();
+#endif
+}
+
+// Called whenever the connection request is resolved, only requests that reached the driver and succeeded are sampled
+static inline void _aos_wifi_client_stats_connect_end(_aos_wifi_client_ctx_t *ctx, bool success)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    if (success && ctx->stats.connect_since)
+        _aos_wifi_client_stats_histogram_add(&ctx->stats.stats.connect_latency, ctx->stats.connect_since);
+    ctx->stats.connect_since = 0;
+#endif
+}
+
+static inline void _aos_wifi_client_stats_scan_begin(_aos_wifi_client_ctx_t *ctx)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    ctx->stats.scan_since = esp_timer_get_time();
+#endif
+}
+
+static inline void _aos_wifi_client_stats_scan_end(_aos_wifi_client_ctx_t *ctx)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    _aos_wifi_client_stats_histogram_add(&ctx->stats.stats.scan_latency, ctx->stats.scan_since);
+#endif
+}
+
+static inline void _aos_wifi_client_stats_attempt(_aos_wifi_client_ctx_t *ctx, bool reconnection)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    if (reconnection)
+        ctx->stats.stats.reconnection_attempts++;
+    else
+        ctx->stats.stats.connection_attempts++;
+#endif
+}
+
+static inline void _aos_wifi_client_stats_reason(_aos_wifi_client_ctx_t *ctx, uint8_t reason)
+{
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    ctx->stats.stats.disconnect_reasons[AOS_WIFI_CLIENT_STATS_REASON_INDEX(reason)]++;
+#endif
+}
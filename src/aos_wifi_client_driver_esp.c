@@ -0,0 +1,81 @@
+/**
+ * @file aos_wifi_client_driver_esp.c
+ * @author Michele Riva (michele.riva@protonmail.com)
+ * @brief AOS WiFi client ESP WiFi driver
+ * @version 0.9.0
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+#include <sdkconfig.h>
+#if !CONFIG_IDF_TARGET_LINUX
+#include <aos_wifi_client_driver.h>
+#include <esp_idf_version.h>
+
+static esp_err_t _aos_wifi_client_driver_esp_init(void)
+{
+    wifi_init_config_t config = WIFI_INIT_CONFIG_DEFAULT();
+    config.nvs_enable = 0;
+    return esp_wifi_init(&config);
+}
+
+static void _aos_wifi_client_driver_esp_netif_destroy(esp_netif_t *netif)
+{
+    esp_netif_destroy_default_wifi(netif);
+}
+
+static esp_err_t _aos_wifi_client_driver_esp_static_ip_set(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info)
+{
+    esp_err_t err;
+    if (!ip_info)
+    {
+        err = esp_netif_dhcpc_start(netif);
+        return err == ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED ? ESP_OK : err;
+    }
+    err = esp_netif_dhcpc_stop(netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED)
+        return err;
+    // With DHCP stopped, esp_netif posts IP_EVENT_STA_GOT_IP with this address as soon as the station associates
+    return esp_netif_set_ip_info(netif, ip_info);
+}
+
+const aos_wifi_client_driver_t aos_wifi_client_driver_esp = {
+    .init = _aos_wifi_client_driver_esp_init,
+    .deinit = esp_wifi_deinit,
+    .netif_create = esp_netif_create_default_wifi_sta,
+    .netif_destroy = _aos_wifi_client_driver_esp_netif_destroy,
+    .set_mode = esp_wifi_set_mode,
+    .set_ps = esp_wifi_set_ps,
+    .set_event_mask = esp_wifi_set_event_mask,
+    .get_event_mask = esp_wifi_get_event_mask,
+    .start = esp_wifi_start,
+    .stop = esp_wifi_stop,
+    .connect = esp_wifi_connect,
+    .disconnect = esp_wifi_disconnect,
+    .get_config = esp_wifi_get_config,
+    .set_config = esp_wifi_set_config,
+    .scan_start = esp_wifi_scan_start,
+    .scan_stop = esp_wifi_scan_stop,
+    .scan_get_ap_num = esp_wifi_scan_get_ap_num,
+    .scan_get_ap_records = esp_wifi_scan_get_ap_records,
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+    .scan_get_ap_record = esp_wifi_scan_get_ap_record,
+    .clear_ap_list = esp_wifi_clear_ap_list,
+#endif
+    .sta_get_ap_info = esp_wifi_sta_get_ap_info,
+    .set_rssi_threshold = esp_wifi_set_rssi_threshold,
+    .static_ip_set = _aos_wifi_client_driver_esp_static_ip_set,
+};
+#endif
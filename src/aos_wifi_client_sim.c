@@ -0,0 +1,682 @@
+/**
+ * @file aos_wifi_client_sim.c
+ * @author Michele Riva (michele.riva@protonmail.com)
+ * @brief AOS WiFi client simulated driver
+ * @version 0.9.0
+ * @date 2023-04-18
+ *
+ * @copyright Copyright (c) 2023
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ * Only the behaviour the client relies on is simulated: a single station interface, scans filtered like the driver
+ * does, association with the strongest matching AP, DHCP and a one shot low RSSI notification.
+ */
+#include <aos_wifi_client_sim.h>
+#include <string.h>
+#include <esp_event.h>
+#include <esp_idf_version.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+#include <sdkconfig.h>
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_LOG_NONE
+#define LOG_LOCAL_LEVEL ESP_LOG_NONE
+#elif CONFIG_AOS_WIFI_CLIENT_LOG_ERROR
+#define LOG_LOCAL_LEVEL ESP_LOG_ERROR
+#elif CONFIG_AOS_WIFI_CLIENT_LOG_WARN
+#define LOG_LOCAL_LEVEL ESP_LOG_WARN
+#elif CONFIG_AOS_WIFI_CLIENT_LOG_INFO
+#define LOG_LOCAL_LEVEL ESP_LOG_INFO
+#elif CONFIG_AOS_WIFI_CLIENT_LOG_DEBUG
+#define LOG_LOCAL_LEVEL ESP_LOG_DEBUG
+#elif CONFIG_AOS_WIFI_CLIENT_LOG_VERBOSE
+#define LOG_LOCAL_LEVEL ESP_LOG_VERBOSE
+#endif
+#include <esp_log.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+// There is no WiFi driver defining the event base on the linux target
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+#endif
+
+#define _AOS_WIFI_CLIENT_SIM_CHANNELS 13
+
+typedef enum _aos_wifi_client_sim_link_t
+{
+    _AOS_WIFI_CLIENT_SIM_LINK_IDLE = 0,
+    _AOS_WIFI_CLIENT_SIM_LINK_CONNECTING,
+    _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED,
+    _AOS_WIFI_CLIENT_SIM_LINK_CONNECTED,
+} _aos_wifi_client_sim_link_t;
+
+typedef struct _aos_wifi_client_sim_ap_t
+{
+    char ssid[33];
+    char password[65];
+    aos_wifi_client_sim_ap_t ap;
+} _aos_wifi_client_sim_ap_t;
+
+typedef struct _aos_wifi_client_sim_t
+{
+    portMUX_TYPE lock;
+    _aos_wifi_client_sim_ap_t aps[AOS_WIFI_CLIENT_SIM_APS];
+    size_t aps_count;
+    unsigned int scan_duration_ms;
+    unsigned int connect_duration_ms;
+    unsigned int dhcp_delay_ms;
+    bool initialized;
+    bool started;
+    wifi_config_t config;
+    uint32_t event_mask;
+    // Scan
+    bool scanning;
+    char scan_ssid[33];
+    uint8_t scan_bssid[6];
+    bool scan_bssid_set;
+    uint16_t scan_channels;
+    bool scan_show_hidden;
+    uint8_t scan_id;
+    wifi_ap_record_t records[AOS_WIFI_CLIENT_SIM_APS];
+    uint16_t records_count;
+    uint16_t records_next;
+    // Link
+    _aos_wifi_client_sim_link_t link;
+    size_t ap;
+    int32_t rssi_threshold;
+    esp_netif_ip_info_t static_ip;
+    bool static_ip_set;
+    TimerHandle_t scan_timer;
+    TimerHandle_t connect_timer;
+    TimerHandle_t dhcp_timer;
+} _aos_wifi_client_sim_t;
+
+static const char *_tag = "AOS WiFi client sim";
+static _aos_wifi_client_sim_t _sim = {.lock = portMUX_INITIALIZER_UNLOCKED};
+static uint8_t _netif_placeholder; // Dereferenced by nobody, only needs to be non NULL
+
+static void _aos_wifi_client_sim_ap_copy(_aos_wifi_client_sim_ap_t *dst, const aos_wifi_client_sim_ap_t *src)
+{
+    dst->ap = *src;
+    strncpy(dst->ssid, src->ssid, sizeof(dst->ssid) - 1);
+    dst->ssid[sizeof(dst->ssid) - 1] = 0;
+    strncpy(dst->password, src->password ? src->password : "", sizeof(dst->password) - 1);
+    dst->password[sizeof(dst->password) - 1] = 0;
+    // Strings are owned by the copy
+    dst->ap.ssid = dst->ssid;
+    dst->ap.password = dst->password;
+}
+
+static void _aos_wifi_client_sim_post(int32_t event_id, const void *data, size_t size)
+{
+    esp_err_t err = esp_event_post(WIFI_EVENT, event_id, data, size, portMAX_DELAY);
+    if (err != ESP_OK)
+        ESP_LOGE(_tag, "Could not post event %d (ESP_error:%s)", event_id, esp_err_to_name(err));
+}
+
+static void _aos_wifi_client_sim_post_disconnected(const _aos_wifi_client_sim_ap_t *ap, uint8_t reason)
+{
+    wifi_event_sta_disconnected_t event = {.reason = reason};
+    if (ap)
+    {
+        event.ssid_len = strlen(ap->ssid);
+        memcpy(event.ssid, ap->ssid, event.ssid_len);
+        memcpy(event.bssid, ap->ap.bssid, sizeof(event.bssid));
+        event.rssi = ap->ap.rssi;
+    }
+    _aos_wifi_client_sim_post(WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event));
+}
+
+static void _aos_wifi_client_sim_pended_disconnected(void *ap, uint32_t reason)
+{
+    _aos_wifi_client_sim_post_disconnected(ap, reason);
+}
+
+static void _aos_wifi_client_sim_timer_set(TimerHandle_t timer, unsigned int delay_ms)
+{
+    TickType_t ticks = pdMS_TO_TICKS(delay_ms);
+    xTimerChangePeriod(timer, ticks ? ticks : 1, 0); // Also called from timer callbacks, must not block
+}
+
+static bool _aos_wifi_client_sim_password_ok(const _aos_wifi_client_sim_ap_t *ap, const wifi_sta_config_t *config)
+{
+    return !ap->password[0] || !strncmp(ap->password, (const char *)config->password, sizeof(config->password));
+}
+
+static void _aos_wifi_client_sim_scan_timer_cb(TimerHandle_t timer)
+{
+    wifi_event_sta_scan_done_t event = {};
+    taskENTER_CRITICAL(&_sim.lock);
+    if (!_sim.scanning)
+    {
+        taskEXIT_CRITICAL(&_sim.lock);
+        return;
+    }
+    _sim.scanning = false;
+    _sim.records_count = 0;
+    _sim.records_next = 0;
+    for (size_t i = 0; i < _sim.aps_count; i++)
+    {
+        const _aos_wifi_client_sim_ap_t *ap = &_sim.aps[i];
+        bool targeted = _sim.scan_ssid[0] && !strcmp(_sim.scan_ssid, ap->ssid);
+        if ((_sim.scan_ssid[0] && !targeted) ||
+            (_sim.scan_bssid_set && memcmp(_sim.scan_bssid, ap->ap.bssid, sizeof(ap->ap.bssid))) ||
+            !(_sim.scan_channels & (1 << (ap->ap.channel - 1))) ||
+            (ap->ap.hidden && !targeted && !_sim.scan_show_hidden))
+            continue;
+
+        // Keep records sorted by signal strength, as the driver does
+        size_t pos = _sim.records_count++;
+        while (pos && _sim.records[pos - 1].rssi < ap->ap.rssi)
+        {
+            _sim.records[pos] = _sim.records[pos - 1];
+            pos--;
+        }
+        wifi_ap_record_t *record = &_sim.records[pos];
+        memset(record, 0, sizeof(*record));
+        memcpy(record->bssid, ap->ap.bssid, sizeof(record->bssid));
+        if (!ap->ap.hidden || targeted)
+            strcpy((char *)record->ssid, ap->ssid);
+        record->primary = ap->ap.channel;
+        record->rssi = ap->ap.rssi;
+        record->authmode = ap->password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    }
+    event.number = _sim.records_count;
+    event.scan_id = ++_sim.scan_id;
+    taskEXIT_CRITICAL(&_sim.lock);
+
+    ESP_LOGD(_tag, "Scan done (%u APs)", event.number);
+    _aos_wifi_client_sim_post(WIFI_EVENT_SCAN_DONE, &event, sizeof(event));
+}
+
+static void _aos_wifi_client_sim_connect_timer_cb(TimerHandle_t timer)
+{
+    const _aos_wifi_client_sim_ap_t *found = NULL;
+    uint8_t reason = 0;
+    taskENTER_CRITICAL(&_sim.lock);
+    if (_sim.link != _AOS_WIFI_CLIENT_SIM_LINK_CONNECTING)
+    {
+        taskEXIT_CRITICAL(&_sim.lock);
+        return;
+    }
+    const wifi_sta_config_t *config = &_sim.config.sta;
+    for (size_t i = 0; i < _sim.aps_count; i++)
+    {
+        const _aos_wifi_client_sim_ap_t *ap = &_sim.aps[i];
+        if (strncmp(ap->ssid, (const char *)config->ssid, sizeof(config->ssid)) ||
+            (config->bssid_set && memcmp(ap->ap.bssid, config->bssid, sizeof(config->bssid))) ||
+            ap->ap.rssi < config->threshold.rssi)
+            continue;
+        if (!found || ap->ap.rssi > found->ap.rssi)
+        {
+            found = ap;
+            _sim.ap = i;
+        }
+    }
+    if (!found)
+        reason = WIFI_REASON_NO_AP_FOUND;
+    else if (found->ap.reject_reason)
+        reason = found->ap.reject_reason;
+    else if (!_aos_wifi_client_sim_password_ok(found, config))
+        reason = WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT;
+    _sim.link = reason ? _AOS_WIFI_CLIENT_SIM_LINK_IDLE : _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED;
+    taskEXIT_CRITICAL(&_sim.lock);
+
+    if (reason)
+    {
+        ESP_LOGD(_tag, "Connection failed (reason:%u)", reason);
+        _aos_wifi_client_sim_post_disconnected(found, reason);
+        return;
+    }
+
+    wifi_event_sta_connected_t event = {.ssid_len = strlen(found->ssid), .channel = found->ap.channel};
+    memcpy(event.ssid, found->ssid, event.ssid_len);
+    memcpy(event.bssid, found->ap.bssid, sizeof(event.bssid));
+    event.authmode = found->password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+    ESP_LOGD(_tag, "Associated");
+    _aos_wifi_client_sim_post(WIFI_EVENT_STA_CONNECTED, &event, sizeof(event));
+    _aos_wifi_client_sim_timer_set(_sim.dhcp_timer, _sim.static_ip_set ? 0 : _sim.dhcp_delay_ms);
+}
+
+static void _aos_wifi_client_sim_dhcp_timer_cb(TimerHandle_t timer)
+{
+    taskENTER_CRITICAL(&_sim.lock);
+    bool associated = _sim.link == _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED;
+    if (associated)
+        _sim.link = _AOS_WIFI_CLIENT_SIM_LINK_CONNECTED;
+    size_t ap = _sim.ap;
+    taskEXIT_CRITICAL(&_sim.lock);
+    if (!associated)
+        return;
+
+    // Every AP gets its own subnet, so the leased address tells which one the station is on
+    ip_event_got_ip_t event = {.esp_netif = (esp_netif_t *)&_netif_placeholder, .ip_changed = true};
+    event.ip_info.ip.addr = ESP_IP4TOADDR(192, 168, ap, 100);
+    event.ip_info.netmask.addr = ESP_IP4TOADDR(255, 255, 255, 0);
+    event.ip_info.gw.addr = ESP_IP4TOADDR(192, 168, ap, 1);
+    if (_sim.static_ip_set)
+        event.ip_info = _sim.static_ip;
+    ESP_LOGD(_tag, "Got IP");
+    esp_err_t err = esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &event, sizeof(event), portMAX_DELAY);
+    if (err != ESP_OK)
+        ESP_LOGE(_tag, "Could not post IP event (ESP_error:%s)", esp_err_to_name(err));
+}
+
+// Stop link and scan activity, returns the AP the station was linked to, if any
+static const _aos_wifi_client_sim_ap_t *_aos_wifi_client_sim_link_stop(void)
+{
+    xTimerStop(_sim.connect_timer, portMAX_DELAY);
+    xTimerStop(_sim.dhcp_timer, portMAX_DELAY);
+    taskENTER_CRITICAL(&_sim.lock);
+    const _aos_wifi_client_sim_ap_t *ap = _sim.link >= _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED ? &_sim.aps[_sim.ap] : NULL;
+    _sim.link = _AOS_WIFI_CLIENT_SIM_LINK_IDLE;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ap;
+}
+
+static esp_err_t _aos_wifi_client_sim_init(void)
+{
+    if (_sim.initialized)
+        return ESP_OK;
+    if (!(_sim.scan_timer = xTimerCreate("aos_wifi_sim_scan", 1, pdFALSE, NULL, _aos_wifi_client_sim_scan_timer_cb)) ||
+        !(_sim.connect_timer = xTimerCreate("aos_wifi_sim_conn", 1, pdFALSE, NULL, _aos_wifi_client_sim_connect_timer_cb)) ||
+        !(_sim.dhcp_timer = xTimerCreate("aos_wifi_sim_dhcp", 1, pdFALSE, NULL, _aos_wifi_client_sim_dhcp_timer_cb)))
+    {
+        if (_sim.scan_timer)
+            xTimerDelete(_sim.scan_timer, portMAX_DELAY);
+        if (_sim.connect_timer)
+            xTimerDelete(_sim.connect_timer, portMAX_DELAY);
+        _sim.scan_timer = _sim.connect_timer = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    memset(&_sim.config, 0, sizeof(_sim.config));
+    _sim.initialized = true;
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_deinit(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (_sim.started)
+        return ESP_ERR_WIFI_NOT_STOPPED;
+    xTimerDelete(_sim.scan_timer, portMAX_DELAY);
+    xTimerDelete(_sim.connect_timer, portMAX_DELAY);
+    xTimerDelete(_sim.dhcp_timer, portMAX_DELAY);
+    _sim.scan_timer = _sim.connect_timer = _sim.dhcp_timer = NULL;
+    _sim.static_ip_set = false;
+    _sim.initialized = false;
+    return ESP_OK;
+}
+
+static esp_netif_t *_aos_wifi_client_sim_netif_create(void)
+{
+    return (esp_netif_t *)&_netif_placeholder;
+}
+
+static void _aos_wifi_client_sim_netif_destroy(esp_netif_t *netif)
+{
+    _sim.static_ip_set = false;
+}
+
+static esp_err_t _aos_wifi_client_sim_static_ip_set(esp_netif_t *netif, const esp_netif_ip_info_t *ip_info)
+{
+    if (netif != (esp_netif_t *)&_netif_placeholder)
+        return ESP_ERR_INVALID_ARG;
+    taskENTER_CRITICAL(&_sim.lock);
+    _sim.static_ip_set = ip_info != NULL;
+    if (ip_info)
+        _sim.static_ip = *ip_info;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_set_mode(wifi_mode_t mode)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    return mode == WIFI_MODE_STA ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+static esp_err_t _aos_wifi_client_sim_set_ps(wifi_ps_type_t type)
+{
+    return _sim.initialized ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+static esp_err_t _aos_wifi_client_sim_set_event_mask(uint32_t mask)
+{
+    // Only kept, nothing is posted that the client did not ask for
+    _sim.event_mask = mask;
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_get_event_mask(uint32_t *mask)
+{
+    if (!mask)
+        return ESP_ERR_INVALID_ARG;
+    *mask = _sim.event_mask;
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_start(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (_sim.started)
+        return ESP_OK;
+    _sim.started = true;
+    _aos_wifi_client_sim_post(WIFI_EVENT_STA_START, NULL, 0);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_stop(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!_sim.started)
+        return ESP_OK;
+    xTimerStop(_sim.scan_timer, portMAX_DELAY);
+    _sim.scanning = false;
+    _aos_wifi_client_sim_link_stop();
+    _sim.started = false;
+    _aos_wifi_client_sim_post(WIFI_EVENT_STA_STOP, NULL, 0);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_connect(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!_sim.started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+    if (!_sim.config.sta.ssid[0])
+        return ESP_ERR_WIFI_SSID;
+
+    // Like the driver, a new connect silently replaces the current link
+    _aos_wifi_client_sim_link_stop();
+    taskENTER_CRITICAL(&_sim.lock);
+    _sim.link = _AOS_WIFI_CLIENT_SIM_LINK_CONNECTING;
+    taskEXIT_CRITICAL(&_sim.lock);
+    _aos_wifi_client_sim_timer_set(_sim.connect_timer, _sim.connect_duration_ms);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_disconnect(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!_sim.started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+    taskENTER_CRITICAL(&_sim.lock);
+    bool linked = _sim.link != _AOS_WIFI_CLIENT_SIM_LINK_IDLE;
+    taskEXIT_CRITICAL(&_sim.lock);
+    const _aos_wifi_client_sim_ap_t *ap = _aos_wifi_client_sim_link_stop();
+    // The driver reports the leave from its own task, posting here would charge the event copy to the caller
+    if (linked && xTimerPendFunctionCall(_aos_wifi_client_sim_pended_disconnected, (void *)ap, WIFI_REASON_ASSOC_LEAVE,
+                                         portMAX_DELAY) != pdPASS)
+        _aos_wifi_client_sim_post_disconnected(ap, WIFI_REASON_ASSOC_LEAVE);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_get_config(wifi_interface_t interface, wifi_config_t *config)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (interface != WIFI_IF_STA || !config)
+        return ESP_ERR_INVALID_ARG;
+    *config = _sim.config;
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_set_config(wifi_interface_t interface, wifi_config_t *config)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (interface != WIFI_IF_STA || !config)
+        return ESP_ERR_INVALID_ARG;
+    _sim.config = *config;
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!_sim.started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+    if (block)
+        return ESP_ERR_NOT_SUPPORTED;
+
+    taskENTER_CRITICAL(&_sim.lock);
+    if (_sim.scanning || _sim.link == _AOS_WIFI_CLIENT_SIM_LINK_CONNECTING)
+    {
+        taskEXIT_CRITICAL(&_sim.lock);
+        return ESP_ERR_WIFI_STATE;
+    }
+    _sim.scan_ssid[0] = 0;
+    _sim.scan_bssid_set = false;
+    _sim.scan_channels = (1 << _AOS_WIFI_CLIENT_SIM_CHANNELS) - 1;
+    _sim.scan_show_hidden = false;
+    if (config)
+    {
+        if (config->ssid)
+            strncpy(_sim.scan_ssid, (const char *)config->ssid, sizeof(_sim.scan_ssid) - 1);
+        if ((_sim.scan_bssid_set = config->bssid))
+            memcpy(_sim.scan_bssid, config->bssid, sizeof(_sim.scan_bssid));
+        if (config->channel)
+            _sim.scan_channels = 1 << (config->channel - 1);
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+        // Bit n stands for channel n, ignored when a single channel is given
+        else if (config->channel_bitmap.ghz_2_channels)
+            _sim.scan_channels = (config->channel_bitmap.ghz_2_channels >> 1) & ((1 << _AOS_WIFI_CLIENT_SIM_CHANNELS) - 1);
+#endif
+        _sim.scan_show_hidden = config->show_hidden;
+    }
+    _sim.scanning = true;
+    taskEXIT_CRITICAL(&_sim.lock);
+
+    unsigned int channels = 0;
+    for (uint16_t mask = _sim.scan_channels; mask; mask &= mask - 1)
+        channels++;
+    _aos_wifi_client_sim_timer_set(_sim.scan_timer, _sim.scan_duration_ms * channels / _AOS_WIFI_CLIENT_SIM_CHANNELS);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_scan_stop(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (!_sim.started)
+        return ESP_ERR_WIFI_NOT_STARTED;
+    xTimerStop(_sim.scan_timer, portMAX_DELAY);
+    taskENTER_CRITICAL(&_sim.lock);
+    _sim.scanning = false;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_scan_get_ap_num(uint16_t *number)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    taskENTER_CRITICAL(&_sim.lock);
+    *number = _sim.records_count - _sim.records_next;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *records)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    taskENTER_CRITICAL(&_sim.lock);
+    uint16_t count = _sim.records_count - _sim.records_next;
+    if (*number > count)
+        *number = count;
+    memcpy(records, &_sim.records[_sim.records_next], *number * sizeof(wifi_ap_record_t));
+    // Records are freed once fetched
+    _sim.records_count = _sim.records_next = 0;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_scan_get_ap_record(wifi_ap_record_t *record)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    esp_err_t err = ESP_FAIL;
+    taskENTER_CRITICAL(&_sim.lock);
+    if (_sim.records_next < _sim.records_count)
+    {
+        *record = _sim.records[_sim.records_next++];
+        err = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&_sim.lock);
+    return err;
+}
+
+static esp_err_t _aos_wifi_client_sim_clear_ap_list(void)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    taskENTER_CRITICAL(&_sim.lock);
+    _sim.records_count = _sim.records_next = 0;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ESP_OK;
+}
+
+static esp_err_t _aos_wifi_client_sim_sta_get_ap_info(wifi_ap_record_t *record)
+{
+    esp_err_t err = ESP_ERR_WIFI_NOT_CONNECT;
+    taskENTER_CRITICAL(&_sim.lock);
+    if (_sim.link >= _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED)
+    {
+        const _aos_wifi_client_sim_ap_t *ap = &_sim.aps[_sim.ap];
+        memset(record, 0, sizeof(*record));
+        memcpy(record->bssid, ap->ap.bssid, sizeof(record->bssid));
+        strcpy((char *)record->ssid, ap->ssid);
+        record->primary = ap->ap.channel;
+        record->rssi = ap->ap.rssi;
+        record->authmode = ap->password[0] ? WIFI_AUTH_WPA2_PSK : WIFI_AUTH_OPEN;
+        err = ESP_OK;
+    }
+    taskEXIT_CRITICAL(&_sim.lock);
+    return err;
+}
+
+// Report a low RSSI once, then disarm until the threshold is set again, as the driver does
+static void _aos_wifi_client_sim_rssi_check(void)
+{
+    wifi_event_bss_rssi_low_t event = {};
+    taskENTER_CRITICAL(&_sim.lock);
+    bool low = _sim.rssi_threshold &&
+               _sim.link >= _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED &&
+               _sim.aps[_sim.ap].ap.rssi < _sim.rssi_threshold;
+    if (low)
+    {
+        event.rssi = _sim.aps[_sim.ap].ap.rssi;
+        _sim.rssi_threshold = 0;
+    }
+    taskEXIT_CRITICAL(&_sim.lock);
+    if (low)
+        _aos_wifi_client_sim_post(WIFI_EVENT_STA_BSS_RSSI_LOW, &event, sizeof(event));
+}
+
+static esp_err_t _aos_wifi_client_sim_set_rssi_threshold(int32_t rssi)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    if (rssi < -100 || rssi > 0)
+        return ESP_ERR_INVALID_ARG;
+    taskENTER_CRITICAL(&_sim.lock);
+    _sim.rssi_threshold = rssi;
+    taskEXIT_CRITICAL(&_sim.lock);
+    _aos_wifi_client_sim_rssi_check();
+    return ESP_OK;
+}
+
+const aos_wifi_client_driver_t aos_wifi_client_driver_sim = {
+    .init = _aos_wifi_client_sim_init,
+    .deinit = _aos_wifi_client_sim_deinit,
+    .netif_create = _aos_wifi_client_sim_netif_create,
+    .netif_destroy = _aos_wifi_client_sim_netif_destroy,
+    .set_mode = _aos_wifi_client_sim_set_mode,
+    .set_ps = _aos_wifi_client_sim_set_ps,
+    .set_event_mask = _aos_wifi_client_sim_set_event_mask,
+    .get_event_mask = _aos_wifi_client_sim_get_event_mask,
+    .start = _aos_wifi_client_sim_start,
+    .stop = _aos_wifi_client_sim_stop,
+    .connect = _aos_wifi_client_sim_connect,
+    .disconnect = _aos_wifi_client_sim_disconnect,
+    .get_config = _aos_wifi_client_sim_get_config,
+    .set_config = _aos_wifi_client_sim_set_config,
+    .scan_start = _aos_wifi_client_sim_scan_start,
+    .scan_stop = _aos_wifi_client_sim_scan_stop,
+    .scan_get_ap_num = _aos_wifi_client_sim_scan_get_ap_num,
+    .scan_get_ap_records = _aos_wifi_client_sim_scan_get_ap_records,
+    .scan_get_ap_record = _aos_wifi_client_sim_scan_get_ap_record,
+    .clear_ap_list = _aos_wifi_client_sim_clear_ap_list,
+    .sta_get_ap_info = _aos_wifi_client_sim_sta_get_ap_info,
+    .set_rssi_threshold = _aos_wifi_client_sim_set_rssi_threshold,
+    .static_ip_set = _aos_wifi_client_sim_static_ip_set,
+};
+
+esp_err_t aos_wifi_client_sim_setup(const aos_wifi_client_sim_config_t *config)
+{
+    if (!config || config->aps_count > AOS_WIFI_CLIENT_SIM_APS || (config->aps_count && !config->aps))
+        return ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; i < config->aps_count; i++)
+        if (!config->aps[i].ssid || config->aps[i].channel < 1 || config->aps[i].channel > _AOS_WIFI_CLIENT_SIM_CHANNELS)
+            return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&_sim.lock);
+    for (size_t i = 0; i < config->aps_count; i++)
+        _aos_wifi_client_sim_ap_copy(&_sim.aps[i], &config->aps[i]);
+    _sim.aps_count = config->aps_count;
+    _sim.scan_duration_ms = config->scan_duration_ms;
+    _sim.connect_duration_ms = config->connect_duration_ms;
+    _sim.dhcp_delay_ms = config->dhcp_delay_ms;
+    taskEXIT_CRITICAL(&_sim.lock);
+    return ESP_OK;
+}
+
+esp_err_t aos_wifi_client_sim_ap_set(size_t index, const aos_wifi_client_sim_ap_t *ap)
+{
+    if (!ap || !ap->ssid || ap->channel < 1 || ap->channel > _AOS_WIFI_CLIENT_SIM_CHANNELS)
+        return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&_sim.lock);
+    if (index >= _sim.aps_count)
+    {
+        taskEXIT_CRITICAL(&_sim.lock);
+        return ESP_ERR_INVALID_ARG;
+    }
+    _aos_wifi_client_sim_ap_copy(&_sim.aps[index], ap);
+    taskEXIT_CRITICAL(&_sim.lock);
+
+    _aos_wifi_client_sim_rssi_check();
+    return ESP_OK;
+}
+
+esp_err_t aos_wifi_client_sim_link_drop(uint8_t reason)
+{
+    if (!_sim.initialized)
+        return ESP_ERR_WIFI_NOT_INIT;
+    taskENTER_CRITICAL(&_sim.lock);
+    bool associated = _sim.link >= _AOS_WIFI_CLIENT_SIM_LINK_ASSOCIATED;
+    taskEXIT_CRITICAL(&_sim.lock);
+    if (!associated)
+        return ESP_ERR_INVALID_STATE;
+    _aos_wifi_client_sim_post_disconnected(_aos_wifi_client_sim_link_stop(), reason);
+    return ESP_OK;
+}
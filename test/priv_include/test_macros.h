@@ -1,4 +1,16 @@
 // https://github.com/ThrowTheSwitch/Unity/blob/master/docs/UnityAssertionsReference.md
+#include <sdkconfig.h>
+
+#if CONFIG_IDF_TARGET_LINUX
+#include <malloc.h>
+
+// No heap tracing on the host, leaks are left to the sanitizers
+#define TEST_HEAP_START
+#define TEST_HEAP_STOP
+
+// Bytes currently allocated
+#define TEST_HEAP_USED() (mallinfo2().uordblks)
+#else
 #include <esp_heap_trace.h>
 #include <esp_heap_caps.h>
 
@@ -13,3 +25,7 @@
         ESP_ERROR_CHECK(heap_trace_stop());                                            \
         printf("Heap tracing ended (%u)\n", heap_caps_get_free_size(MALLOC_CAP_8BIT)); \
     }
+
+// Bytes currently allocated
+#define TEST_HEAP_USED() (heap_caps_get_total_size(MALLOC_CAP_8BIT) - heap_caps_get_free_size(MALLOC_CAP_8BIT))
+#endif
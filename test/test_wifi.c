@@ -1,19 +1,91 @@
 #include <aos_wifi_client.h>
+#include <aos_wifi_client_sim.h>
 #include <esp_netif.h>
 #include <esp_event.h>
+#include <esp_wifi.h>
+#include <sdkconfig.h>
 #include <test_macros.h>
 #include <unity.h>
 #include <unity_test_runner.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 
 static bool _isinit = false;
 static const char *_test_ssid = "MY_SSID";
 static const char *_test_password = "MY_PASSWORD";
+static volatile unsigned int _test_events[AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED + 1];
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+static const aos_wifi_client_sim_ap_t _test_aps[] = {
+    {.ssid = "MY_SSID", .password = "MY_PASSWORD", .bssid = {0x02, 0, 0, 0, 0, 1}, .channel = 1, .rssi = -50},
+    {.ssid = "MY_SSID", .password = "MY_PASSWORD", .bssid = {0x02, 0, 0, 0, 0, 2}, .channel = 6, .rssi = -65},
+    {.ssid = "OPEN_SSID", .bssid = {0x02, 0, 0, 0, 0, 3}, .channel = 11, .rssi = -80},
+};
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX || defined(CONFIG_HEAP_USE_HOOKS)
+#define TEST_ALLOC_COUNT 1
+// Allocations made by the test and client tasks while _test_alloc_task is set
+static TaskHandle_t volatile _test_alloc_task;
+static TaskHandle_t volatile _test_client_task;
+static volatile unsigned int _test_allocs;
+
+static void test_alloc_count(void)
+{
+    if (!_test_alloc_task)
+        return;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (task == _test_alloc_task || task == _test_client_task)
+        __atomic_fetch_add(&_test_allocs, 1, __ATOMIC_RELAXED);
+}
+
+#if CONFIG_IDF_TARGET_LINUX
+// Linked with -Wl,--wrap, see CMakeLists.txt
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    test_alloc_count();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    test_alloc_count();
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    test_alloc_count();
+    return __real_realloc(ptr, size);
+}
+#else
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    test_alloc_count();
+}
+#endif
+#endif
 
 static void test_event_handler(aos_wifi_client_event_t event, void *args)
 {
+#ifdef TEST_ALLOC_COUNT
+    _test_client_task = xTaskGetCurrentTaskHandle();
+#endif
     printf("Event:%d\n", event);
+    _test_events[event]++;
+}
+
+static bool test_scan_cb(const aos_wifi_client_scan_result_t *result, void *arg)
+{
+    size_t *count = arg;
+    (*count)++;
+    printf("Scan result (ssid:%s, strength:%f, open:%u)\n", result->ssid, result->strength, result->open);
+    return true;
 }
 
 static void test_init()
@@ -27,7 +99,18 @@ static void test_init()
     aos_wifi_client_config_t config = {
         .connection_attempts = UINT32_MAX,
         .reconnection_attempts = UINT32_MAX,
-        .event_handler = test_event_handler};
+        .event_handler = test_event_handler,
+        .link_monitor = {.period_ms = 100, .rssi_threshold = -75}};
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+    aos_wifi_client_sim_config_t sim_config = {
+        .aps = _test_aps,
+        .aps_count = sizeof(_test_aps) / sizeof(_test_aps[0]),
+        .scan_duration_ms = 1300,
+        .connect_duration_ms = 100,
+        .dhcp_delay_ms = 50};
+    ESP_ERROR_CHECK(aos_wifi_client_sim_setup(&sim_config));
+    config.driver = &aos_wifi_client_driver_sim;
+#endif
     aos_wifi_client_init(&config);
 }
 
@@ -70,7 +153,7 @@ TEST_CASE("Start/connect/disconnect/stop", "[wifi_client]")
     TEST_ASSERT_EQUAL(0, start_args->out_err);
     aos_awaitable_free(start);
 
-    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0);
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
     TEST_ASSERT_NOT_NULL(connect);
     TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
     AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
@@ -104,11 +187,11 @@ TEST_CASE("Start/connect/connect/disconnect/connect/stop (late await)", "[wifi_c
     TEST_ASSERT_EQUAL(0, start_args->out_err);
     aos_awaitable_free(start);
 
-    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0);
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
     TEST_ASSERT_NOT_NULL(connect);
     aos_wifi_client_connect(connect);
 
-    aos_future_t *connect1 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0);
+    aos_future_t *connect1 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
     TEST_ASSERT_NOT_NULL(connect1);
     aos_wifi_client_connect(connect1);
 
@@ -116,7 +199,7 @@ TEST_CASE("Start/connect/connect/disconnect/connect/stop (late await)", "[wifi_c
     TEST_ASSERT_NOT_NULL(disconnect);
     aos_wifi_client_disconnect(disconnect);
 
-    aos_future_t *connect2 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0);
+    aos_future_t *connect2 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
     TEST_ASSERT_NOT_NULL(connect2);
     aos_wifi_client_connect(connect2);
 
@@ -164,7 +247,7 @@ TEST_CASE("Start/scan/stop", "[wifi_client]")
     aos_awaitable_free(start);
 
     aos_wifi_client_scan_result_t results[10] = {};
-    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, 0, 0);
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
     TEST_ASSERT_NOT_NULL(scan);
     TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan(scan))));
     AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
@@ -198,7 +281,7 @@ TEST_CASE("Start/scan/stop (late await)", "[wifi_client]")
     aos_awaitable_free(start);
 
     aos_wifi_client_scan_result_t results[10] = {};
-    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, 0, 0);
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
     TEST_ASSERT_NOT_NULL(scan);
     aos_wifi_client_scan(scan);
 
@@ -231,12 +314,12 @@ TEST_CASE("Start/connect/scan/stop (late await)", "[wifi_client]")
     TEST_ASSERT_EQUAL(0, start_args->out_err);
     aos_awaitable_free(start);
 
-    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0);
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
     TEST_ASSERT_NOT_NULL(connect);
     aos_wifi_client_connect(connect);
 
     aos_wifi_client_scan_result_t results[10] = {};
-    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, 0, 0);
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
     TEST_ASSERT_NOT_NULL(scan);
     aos_wifi_client_scan(scan);
 
@@ -261,4 +344,1030 @@ TEST_CASE("Start/connect/scan/stop (late await)", "[wifi_client]")
     vTaskDelay(pdMS_TO_TICKS(1));
 
     TEST_HEAP_STOP
-}
\ No newline at end of file
+}
+
+TEST_CASE("Start/connect (wrong password)/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, "WRONG_PASSWORD", 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_AUTH, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/set power mode/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *power = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_set_power_mode)(AOS_WIFI_CLIENT_POWER_SAVING, 10, 0);
+    TEST_ASSERT_NOT_NULL(power);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_set_power_mode(power))));
+    AOS_ARGS_T(aos_wifi_client_set_power_mode) *power_args = aos_args_get(power);
+    TEST_ASSERT_EQUAL(0, power_args->out_err);
+    aos_awaitable_free(power);
+
+    aos_wifi_client_power_t profile = {.mode = AOS_WIFI_CLIENT_POWER_SAVING, .listen_interval = 10};
+    aos_wifi_client_power_tradeoff_t tradeoff = {};
+    aos_wifi_client_power_tradeoff_get(&profile, &tradeoff);
+    TEST_ASSERT_GREATER_THAN(0, tradeoff.max_latency_ms);
+    TEST_ASSERT_LESS_THAN(100, tradeoff.throughput_pct);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/scan stream/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    size_t count = 0;
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan_stream)(test_scan_cb, &count, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan_stream(scan))));
+    AOS_ARGS_T(aos_wifi_client_scan_stream) *scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(0, scan_args->out_err);
+    TEST_ASSERT_EQUAL(count, scan_args->out_results_count);
+    aos_awaitable_free(scan);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/scan/scan/stop (coalesced)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_wifi_client_scan_result_t results[10] = {};
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    aos_wifi_client_scan(scan);
+
+    aos_wifi_client_scan_result_t results1[10] = {};
+    aos_future_t *scan1 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results1, 10, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan1);
+    aos_wifi_client_scan(scan1);
+
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(scan)));
+    AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(0, scan_args->out_err);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(scan1)));
+    AOS_ARGS_T(aos_wifi_client_scan) *scan1_args = aos_args_get(scan1);
+    TEST_ASSERT_EQUAL(0, scan1_args->out_err);
+    TEST_ASSERT_EQUAL(scan_args->out_results_count, scan1_args->out_results_count);
+    aos_awaitable_free(scan);
+    aos_awaitable_free(scan1);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/scan/stop (targeted)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_wifi_client_scan_spec_t spec = {.ssid = _test_ssid, .min_dwell_ms = 20, .max_dwell_ms = 40};
+    aos_wifi_client_scan_result_t results[10] = {};
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, &spec, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan(scan))));
+    AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(0, scan_args->out_err);
+    TEST_ASSERT_GREATER_THAN(0, scan_args->out_results_count);
+    for (size_t i = 0; i < scan_args->out_results_count; i++)
+    {
+        TEST_ASSERT_EQUAL_STRING(_test_ssid, results[i].ssid);
+    }
+    aos_awaitable_free(scan);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/network add/connect best/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    // A preferred network out of range is skipped
+    aos_future_t *add = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_network_add)("NOT_IN_RANGE", "password", 10, 0);
+    TEST_ASSERT_NOT_NULL(add);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_network_add(add))));
+    AOS_ARGS_T(aos_wifi_client_network_add) *add_args = aos_args_get(add);
+    TEST_ASSERT_EQUAL(0, add_args->out_err);
+    aos_awaitable_free(add);
+
+    add = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_network_add)(_test_ssid, _test_password, 1, 0);
+    TEST_ASSERT_NOT_NULL(add);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_network_add(add))));
+    add_args = aos_args_get(add);
+    TEST_ASSERT_EQUAL(0, add_args->out_err);
+    aos_awaitable_free(add);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect_best)(0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect_best(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect_best) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    aos_future_t *remove = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_network_remove)("NOT_IN_RANGE", 0);
+    TEST_ASSERT_NOT_NULL(remove);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_network_remove(remove))));
+    AOS_ARGS_T(aos_wifi_client_network_remove) *remove_args = aos_args_get(remove);
+    TEST_ASSERT_EQUAL(0, remove_args->out_err);
+    aos_awaitable_free(remove);
+
+    remove = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_network_remove)(_test_ssid, 0);
+    TEST_ASSERT_NOT_NULL(remove);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_network_remove(remove))));
+    remove_args = aos_args_get(remove);
+    TEST_ASSERT_EQUAL(0, remove_args->out_err);
+    aos_awaitable_free(remove);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/connect/roam stats/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    // Roaming is disabled in the test configuration
+    aos_future_t *stats = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_roam_stats_get)((aos_wifi_client_roam_stats_t){});
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_roam_stats_get(stats))));
+    AOS_ARGS_T(aos_wifi_client_roam_stats_get) *stats_args = aos_args_get(stats);
+    TEST_ASSERT_EQUAL(0, stats_args->out_stats.scans);
+    TEST_ASSERT_EQUAL(0, stats_args->out_stats.attempts);
+    aos_awaitable_free(stats);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/scan/event stats/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_wifi_client_scan_result_t results[10] = {};
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan(scan))));
+    aos_awaitable_free(scan);
+
+    aos_future_t *stats = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_event_stats_get)((aos_wifi_client_event_stats_t){});
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_event_stats_get(stats))));
+    AOS_ARGS_T(aos_wifi_client_event_stats_get) *stats_args = aos_args_get(stats);
+    TEST_ASSERT_GREATER_THAN(0, stats_args->out_stats.wifi[WIFI_EVENT_SCAN_DONE]);
+#ifndef CONFIG_AOS_WIFI_CLIENT_EVENT_ANY
+    // Not subscribed to
+    TEST_ASSERT_EQUAL(0, stats_args->out_stats.wifi[WIFI_EVENT_STA_START]);
+    TEST_ASSERT_EQUAL(0, stats_args->out_stats.wifi[WIFI_EVENT_STA_CONNECTED]);
+#endif
+    aos_awaitable_free(stats);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/connect/get stats/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    aos_future_t *stats = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_get_stats)((aos_wifi_client_stats_t){}, 0);
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_get_stats(stats))));
+    AOS_ARGS_T(aos_wifi_client_get_stats) *stats_args = aos_args_get(stats);
+#ifdef CONFIG_AOS_WIFI_CLIENT_STATS
+    TEST_ASSERT_EQUAL(0, stats_args->out_err);
+    TEST_ASSERT_GREATER_THAN(0, stats_args->out_stats.connect_latency.count);
+    TEST_ASSERT_GREATER_THAN(0, stats_args->out_stats.connection_attempts);
+    TEST_ASSERT_GREATER_THAN(0, stats_args->out_stats.queue_hwm);
+    printf("Connect latency (count:%u max_ms:%u)\n", stats_args->out_stats.connect_latency.count, stats_args->out_stats.connect_latency.max_ms);
+#else
+    TEST_ASSERT_EQUAL(1, stats_args->out_err);
+#endif
+    aos_awaitable_free(stats);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+TEST_CASE("Start/connect/link drop/stop (sim)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    // The client is expected to recover the link on its own
+    unsigned int reconnected = _test_events[AOS_WIFI_CLIENT_EVENT_RECONNECTED];
+    TEST_ASSERT_EQUAL(ESP_OK, aos_wifi_client_sim_link_drop(WIFI_REASON_BEACON_TIMEOUT));
+    for (int i = 0; i < 100 && _test_events[AOS_WIFI_CLIENT_EVENT_RECONNECTED] == reconnected; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    TEST_ASSERT_EQUAL(reconnected + 1, _test_events[AOS_WIFI_CLIENT_EVENT_RECONNECTED]);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+#endif
+
+TEST_CASE("Start/connect/status/disconnect/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_wifi_client_status_t status = {};
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_STATE_DISCONNECTED, status.state);
+    uint32_t generation = status.generation;
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_STATE_CONNECTED, status.state);
+    TEST_ASSERT_NOT_EQUAL(0, status.ip);
+    TEST_ASSERT_NOT_EQUAL(0, status.channel);
+    TEST_ASSERT_GREATER_THAN(generation, status.generation);
+    printf("Status (ip:" IPSTR " channel:%u rssi:%d generation:%u)\n", IP2STR((esp_ip4_addr_t *)&status.ip), status.channel, status.rssi, status.generation);
+
+    aos_future_t *disconnect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_disconnect)();
+    TEST_ASSERT_NOT_NULL(disconnect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_disconnect(disconnect))));
+    aos_awaitable_free(disconnect);
+
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_STATE_DISCONNECTED, status.state);
+    TEST_ASSERT_EQUAL(0, status.ip);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+TEST_CASE("Start/wait connected (timeout)/connect (late await)/stop", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *timeout = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_wait_connected)(100, 0);
+    TEST_ASSERT_NOT_NULL(timeout);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_wait_connected(timeout))));
+    AOS_ARGS_T(aos_wifi_client_wait_connected) *timeout_args = aos_args_get(timeout);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_TIMEOUT, timeout_args->out_err);
+    aos_awaitable_free(timeout);
+
+    aos_future_t *wait1 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_wait_connected)(0, 0);
+    aos_future_t *wait2 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_wait_connected)(30000, 0);
+    TEST_ASSERT_NOT_NULL(wait1);
+    TEST_ASSERT_NOT_NULL(wait2);
+    aos_wifi_client_wait_connected(wait1);
+    aos_wifi_client_wait_connected(wait2);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(wait1)));
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(wait2)));
+    AOS_ARGS_T(aos_wifi_client_wait_connected) *wait1_args = aos_args_get(wait1);
+    AOS_ARGS_T(aos_wifi_client_wait_connected) *wait2_args = aos_args_get(wait2);
+    TEST_ASSERT_EQUAL(0, wait1_args->out_err);
+    TEST_ASSERT_EQUAL(0, wait2_args->out_err);
+    aos_awaitable_free(wait1);
+    aos_awaitable_free(wait2);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+TEST_CASE("Start/subscribe/connect/link drop/unsubscribe/stop (sim)", "[wifi_client]")
+{
+    test_init();
+    QueueHandle_t queue = xQueueCreate(4, sizeof(aos_wifi_client_notification_t));
+    TEST_ASSERT_NOT_NULL(queue);
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *subscribe = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_subscribe)(queue, AOS_WIFI_CLIENT_EVENT_MASK(AOS_WIFI_CLIENT_EVENT_RECONNECTED), 0);
+    TEST_ASSERT_NOT_NULL(subscribe);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_subscribe(subscribe))));
+    AOS_ARGS_T(aos_wifi_client_subscribe) *subscribe_args = aos_args_get(subscribe);
+    TEST_ASSERT_EQUAL(0, subscribe_args->out_err);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    // Only the subscribed event is delivered
+    TEST_ASSERT_EQUAL(ESP_OK, aos_wifi_client_sim_link_drop(WIFI_REASON_BEACON_TIMEOUT));
+    aos_wifi_client_notification_t notification = {};
+    TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(queue, &notification, pdMS_TO_TICKS(1000)));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_EVENT_RECONNECTED, notification.event);
+    TEST_ASSERT_EQUAL(0, notification.dropped);
+    TEST_ASSERT_EQUAL(pdFALSE, xQueueReceive(queue, &notification, 0));
+
+    subscribe_args->in_mask = 0;
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_subscribe(subscribe))));
+    TEST_ASSERT_EQUAL(0, subscribe_args->out_err);
+    aos_awaitable_free(subscribe);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+    vQueueDelete(queue);
+}
+#endif
+
+TEST_CASE("Start/connect/connect/stop (joined)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    // Same network, the second request joins the first instead of restarting the association
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    aos_wifi_client_connect(connect);
+    aos_future_t *connect1 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect1);
+    aos_wifi_client_connect(connect1);
+
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(connect)));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(connect1)));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect1_args = aos_args_get(connect1);
+    TEST_ASSERT_EQUAL(0, connect1_args->out_err);
+    TEST_ASSERT_EQUAL(connect_args->out_fastpath, connect1_args->out_fastpath);
+    aos_awaitable_free(connect);
+    aos_awaitable_free(connect1);
+
+    // Disconnecting and connecting back nets out to staying connected
+    aos_future_t *disconnect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_disconnect)();
+    TEST_ASSERT_NOT_NULL(disconnect);
+    aos_wifi_client_disconnect(disconnect);
+    aos_future_t *connect2 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect2);
+    aos_wifi_client_connect(connect2);
+
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(disconnect)));
+    aos_awaitable_free(disconnect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(connect2)));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect2_args = aos_args_get(connect2);
+    TEST_ASSERT_EQUAL(0, connect2_args->out_err);
+    aos_awaitable_free(connect2);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+
+#if defined(CONFIG_AOS_WIFI_CLIENT_TEST_SIM) && defined(CONFIG_AOS_WIFI_CLIENT_EVENT_LANE)
+TEST_CASE("Start/connect/disconnected event burst/stop (sim)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    // Repeated disconnections for the same link, the event loop must never wait for the client task
+    unsigned int reconnected = _test_events[AOS_WIFI_CLIENT_EVENT_RECONNECTED];
+    TEST_ASSERT_EQUAL(ESP_OK, aos_wifi_client_sim_link_drop(WIFI_REASON_BEACON_TIMEOUT));
+    wifi_event_sta_disconnected_t event = {.reason = WIFI_REASON_BEACON_TIMEOUT};
+    for (int i = 0; i < 8; i++)
+        TEST_ASSERT_EQUAL(ESP_OK, esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event), 0));
+    for (int i = 0; i < 100 && _test_events[AOS_WIFI_CLIENT_EVENT_RECONNECTED] == reconnected; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    TEST_ASSERT_GREATER_THAN(reconnected, _test_events[AOS_WIFI_CLIENT_EVENT_RECONNECTED]);
+
+    aos_future_t *stats = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_event_stats_get)((aos_wifi_client_event_stats_t){});
+    TEST_ASSERT_NOT_NULL(stats);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_event_stats_get(stats))));
+    AOS_ARGS_T(aos_wifi_client_event_stats_get) *stats_args = aos_args_get(stats);
+    TEST_ASSERT_EQUAL(0, stats_args->out_stats.wakeups_failed);
+    TEST_ASSERT_LESS_OR_EQUAL(9, stats_args->out_stats.coalesced);
+    aos_awaitable_free(stats);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+#endif
+
+#if defined(CONFIG_AOS_WIFI_CLIENT_STATIC) && defined(CONFIG_AOS_WIFI_CLIENT_TEST_SIM) && defined(TEST_ALLOC_COUNT)
+static void test_static_cycle(aos_future_t *connect, aos_future_t *scan, aos_future_t *disconnect)
+{
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan(scan))));
+    AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(0, scan_args->out_err);
+
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_disconnect(disconnect))));
+}
+
+TEST_CASE("Start/connect/scan/disconnect/stop (static, no heap)", "[wifi_client]")
+{
+    test_init();
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    AOS_ARGS_T(aos_wifi_client_start) *start_args = aos_args_get(start);
+    TEST_ASSERT_EQUAL(0, start_args->out_err);
+    aos_awaitable_free(start);
+
+    static aos_wifi_client_scan_result_t results[10];
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
+    aos_future_t *disconnect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_disconnect)();
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_NOT_NULL(scan);
+    TEST_ASSERT_NOT_NULL(disconnect);
+
+    // The first cycle brings up the client task and lets the event loop and stdout settle their own buffers
+    test_static_cycle(connect, scan, disconnect);
+    TEST_ASSERT_NOT_NULL(_test_client_task);
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    // Only the test and client tasks are counted, the simulated driver posts its events from the timer task
+    _test_allocs = 0;
+    _test_alloc_task = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < 3; i++)
+        test_static_cycle(connect, scan, disconnect);
+    vTaskDelay(pdMS_TO_TICKS(10));
+    _test_alloc_task = NULL;
+    TEST_ASSERT_EQUAL(0, _test_allocs);
+
+    aos_awaitable_free(connect);
+    aos_awaitable_free(scan);
+    aos_awaitable_free(disconnect);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+}
+#endif
+
+#if defined(CONFIG_AOS_WIFI_CLIENT_TEST_SIM) && defined(CONFIG_AOS_WIFI_CLIENT_RESUME)
+static TickType_t test_resume_connect(bool *fastpath)
+{
+    TickType_t begin = xTaskGetTickCount();
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    *fastpath = connect_args->out_fastpath;
+    aos_awaitable_free(connect);
+    return xTaskGetTickCount() - begin;
+}
+
+TEST_CASE("Start/connect/stop/start/connect (resume lease, sim)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    aos_awaitable_free(start);
+
+    // Obtain and persist a lease
+    bool fastpath;
+    test_resume_connect(&fastpath);
+    aos_wifi_client_status_t status = {};
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    uint32_t ip = status.ip;
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    // Make DHCP slow enough to tell whether it ran
+    aos_wifi_client_sim_config_t sim_config = {
+        .aps = _test_aps,
+        .aps_count = sizeof(_test_aps) / sizeof(_test_aps[0]),
+        .scan_duration_ms = 1300,
+        .connect_duration_ms = 100,
+        .dhcp_delay_ms = 1000};
+    TEST_ASSERT_EQUAL(ESP_OK, aos_wifi_client_sim_setup(&sim_config));
+
+    start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    aos_awaitable_free(start);
+
+    // Resumed, straight to the AP and no DHCP
+    TEST_ASSERT_LESS_THAN(pdMS_TO_TICKS(1000), test_resume_connect(&fastpath));
+    TEST_ASSERT_TRUE(fastpath);
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(ip, status.ip);
+
+    // Invalidated, back to DHCP
+    aos_wifi_client_resume_invalidate();
+    aos_future_t *disconnect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_disconnect)();
+    TEST_ASSERT_NOT_NULL(disconnect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_disconnect(disconnect))));
+    aos_awaitable_free(disconnect);
+    TEST_ASSERT_GREATER_OR_EQUAL(pdMS_TO_TICKS(1000), test_resume_connect(&fastpath));
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(ip, status.ip);
+
+    stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+#endif
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+TEST_CASE("Start/connect (deadline)/scan (deadline)/scan/stop (sim)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    aos_awaitable_free(start);
+
+    // Retried forever without a deadline
+    TickType_t begin = xTaskGetTickCount();
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)("NO_SSID", _test_password, 500, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_TIMEOUT, connect_args->out_err);
+    TEST_ASSERT_LESS_THAN(pdMS_TO_TICKS(600), xTaskGetTickCount() - begin);
+    aos_awaitable_free(connect);
+    aos_wifi_client_status_t status = {};
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_STATE_DISCONNECTED, status.state);
+
+    // A full scan takes 1300ms
+    aos_wifi_client_scan_result_t results[10] = {};
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 100, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan(scan))));
+    AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_TIMEOUT, scan_args->out_err);
+    TEST_ASSERT_EQUAL(0, scan_args->out_results_count);
+    aos_awaitable_free(scan);
+
+    // The abandoned scan was stopped, a new one starts right away
+    scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_scan(scan))));
+    scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(0, scan_args->out_err);
+    TEST_ASSERT_EQUAL(sizeof(_test_aps) / sizeof(_test_aps[0]), scan_args->out_results_count);
+    aos_awaitable_free(scan);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+#endif
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+TEST_CASE("Start/scan/cancel/connect/cancel/stop (sim)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    aos_awaitable_free(start);
+
+    // Two requests share the scan, it keeps running for the one left
+    TickType_t begin = xTaskGetTickCount();
+    aos_wifi_client_scan_result_t results[10] = {};
+    aos_wifi_client_scan_result_t results1[10] = {};
+    aos_future_t *scan = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results, 10, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan);
+    aos_future_t *scan1 = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_scan)(results1, 10, NULL, 0, 0, 0);
+    TEST_ASSERT_NOT_NULL(scan1);
+    aos_wifi_client_scan(scan);
+    aos_wifi_client_scan(scan1);
+    aos_future_t *cancel = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_cancel)(scan);
+    TEST_ASSERT_NOT_NULL(cancel);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_cancel(cancel))));
+    AOS_ARGS_T(aos_wifi_client_cancel) *cancel_args = aos_args_get(cancel);
+    TEST_ASSERT_EQUAL(0, cancel_args->out_err);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(scan)));
+    AOS_ARGS_T(aos_wifi_client_scan) *scan_args = aos_args_get(scan);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_CANCELLED, scan_args->out_err);
+    TEST_ASSERT_LESS_THAN(pdMS_TO_TICKS(100), xTaskGetTickCount() - begin);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(scan1)));
+    scan_args = aos_args_get(scan1);
+    TEST_ASSERT_EQUAL(0, scan_args->out_err);
+    TEST_ASSERT_EQUAL(sizeof(_test_aps) / sizeof(_test_aps[0]), scan_args->out_results_count);
+    aos_awaitable_free(scan1);
+
+    // Already resolved
+    aos_awaitable_free(cancel);
+    cancel = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_cancel)(scan);
+    TEST_ASSERT_NOT_NULL(cancel);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_cancel(cancel))));
+    cancel_args = aos_args_get(cancel);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_FAIL, cancel_args->out_err);
+    aos_awaitable_free(cancel);
+    aos_awaitable_free(scan);
+
+    // Nobody else depends on the connection attempt, the client is left disconnected
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)("NO_SSID", _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    aos_wifi_client_connect(connect);
+    cancel = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_cancel)(connect);
+    TEST_ASSERT_NOT_NULL(cancel);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_cancel(cancel))));
+    cancel_args = aos_args_get(cancel);
+    TEST_ASSERT_EQUAL(0, cancel_args->out_err);
+    aos_awaitable_free(cancel);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(connect)));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_ERR_CANCELLED, connect_args->out_err);
+    aos_awaitable_free(connect);
+    aos_wifi_client_status_t status = {};
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_STATE_DISCONNECTED, status.state);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+#endif
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+TEST_CASE("Start/connect list/stop (sim)", "[wifi_client]")
+{
+    test_init();
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    aos_awaitable_free(start);
+
+    // Missing network given up after its own budget, wrong password right away
+    const aos_wifi_client_credentials_t list[] = {
+        {.ssid = "NO_SSID", .password = _test_password, .attempts = 1},
+        {.ssid = _test_ssid, .password = "WRONG_PASSWORD"},
+        {.ssid = _test_ssid, .password = _test_password},
+    };
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect_list)(list, sizeof(list) / sizeof(list[0]), 0, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect_list(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect_list) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    TEST_ASSERT_EQUAL(2, connect_args->out_index);
+    aos_awaitable_free(connect);
+
+    // Already on the first entry
+    connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect_list)(&list[2], 1, 0, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect_list(connect))));
+    connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    TEST_ASSERT_EQUAL(0, connect_args->out_index);
+    aos_awaitable_free(connect);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+}
+#endif
+
+#ifdef CONFIG_AOS_WIFI_CLIENT_TEST_SIM
+TEST_CASE("Start/subscribe/connect/weak signal/stop (link monitor, sim)", "[wifi_client]")
+{
+    test_init();
+    QueueHandle_t queue = xQueueCreate(4, sizeof(aos_wifi_client_notification_t));
+    TEST_ASSERT_NOT_NULL(queue);
+    TEST_HEAP_START
+
+    aos_future_t *start = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_start)(0);
+    TEST_ASSERT_NOT_NULL(start);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_start(start))));
+    aos_awaitable_free(start);
+
+    aos_future_t *subscribe = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_subscribe)(queue, AOS_WIFI_CLIENT_EVENT_MASK(AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED), 0);
+    TEST_ASSERT_NOT_NULL(subscribe);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_subscribe(subscribe))));
+    AOS_ARGS_T(aos_wifi_client_subscribe) *subscribe_args = aos_args_get(subscribe);
+    TEST_ASSERT_EQUAL(0, subscribe_args->out_err);
+
+    aos_future_t *connect = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_connect)(_test_ssid, _test_password, 0, 0, false);
+    TEST_ASSERT_NOT_NULL(connect);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_connect(connect))));
+    AOS_ARGS_T(aos_wifi_client_connect) *connect_args = aos_args_get(connect);
+    TEST_ASSERT_EQUAL(0, connect_args->out_err);
+    aos_awaitable_free(connect);
+
+    // Steady signal, nothing to report
+    vTaskDelay(pdMS_TO_TICKS(500));
+    aos_wifi_client_status_t status = {};
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_FLOAT_WITHIN(1, status.rssi, status.rssi_avg);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, status.rssi_trend);
+    aos_wifi_client_notification_t notification = {};
+    TEST_ASSERT_EQUAL(pdFALSE, xQueueReceive(queue, &notification, 0));
+
+    // Fading signal, reported once the average crosses the threshold
+    for (size_t i = 0; i < 2; i++)
+    {
+        aos_wifi_client_sim_ap_t ap = _test_aps[i];
+        ap.rssi = -90;
+        TEST_ASSERT_EQUAL(ESP_OK, aos_wifi_client_sim_ap_set(i, &ap));
+    }
+    TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(queue, &notification, pdMS_TO_TICKS(2000)));
+    TEST_ASSERT_EQUAL(AOS_WIFI_CLIENT_EVENT_LINK_DEGRADED, notification.event);
+    TEST_ASSERT_LESS_THAN(-75, notification.data.link_degraded.rssi_avg);
+    TEST_ASSERT_LESS_THAN(0, notification.data.link_degraded.rssi_trend);
+    TEST_ASSERT_TRUE(aos_wifi_client_status_get(&status));
+    TEST_ASSERT_LESS_THAN(-75, status.rssi_avg);
+
+    subscribe_args->in_mask = 0;
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_subscribe(subscribe))));
+    aos_awaitable_free(subscribe);
+
+    aos_future_t *stop = AOS_AWAITABLE_ALLOC_T(aos_wifi_client_stop)();
+    TEST_ASSERT_NOT_NULL(stop);
+    TEST_ASSERT_TRUE(aos_isresolved(aos_await(aos_wifi_client_stop(stop))));
+    aos_awaitable_free(stop);
+
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+    TEST_HEAP_STOP
+    vQueueDelete(queue);
+}
+#endif
\ No newline at end of file